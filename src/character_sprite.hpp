@@ -0,0 +1,71 @@
+#ifndef CHARACTER_SPRITE_HPP
+#define CHARACTER_SPRITE_HPP
+
+#include <SFML/System.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "tileset.hpp"
+#include "creature.hpp"
+
+// How one character looks on the client. Everything it draws with
+// comes from the creature's prototype, so this only holds the sprite
+// and where the animation has got to
+class CharacterSprite : public sf::Drawable
+{
+private:
+
+    sf::Sprite mSprite;
+    unsigned int mTs;
+    const Animation* mAnim;
+    float mAnimT;
+    unsigned int mAnimCurrentFrame;
+
+public:
+
+    CharacterSprite() : mTs(0), mAnim(nullptr), mAnimT(0.0f), mAnimCurrentFrame(0) {}
+    explicit CharacterSprite(const Creature& proto) :
+        mTs(proto.getTilesize()),
+        mAnim(proto.getIdleAnimation()),
+        mAnimT(0.0f),
+        mAnimCurrentFrame(0)
+    {
+        if(proto.getTileset() == nullptr || mAnim == nullptr) return;
+        mSprite.setTexture(proto.getTileset()->tex);
+        mSprite.setTextureRect(sf::IntRect(mAnim->x, mAnim->y, mTs, mTs));
+        mSprite.setOrigin(mTs/2.0, mTs/2.0);
+    }
+
+    // Put the sprite at a position in tiles
+    void place(const sf::Vector2f& tilePos)
+    {
+        mSprite.setPosition(tilePos * (float)mTs);
+    }
+
+    void update(float dt)
+    {
+        if(mAnim == nullptr) return;
+        mAnimT += dt;
+        int frame = mAnimT * mAnim->len / mAnim->duration;
+        if(frame >= mAnim->len) frame %= mAnim->len;
+        // No point changing the frame when it doesn't need to be
+        if(frame != mAnimCurrentFrame)
+        {
+            mSprite.setTextureRect(sf::IntRect(
+                    mAnim->x + frame * mTs,
+                    mAnim->y,
+                    mTs,
+                    mTs));
+            mAnimCurrentFrame = frame;
+        }
+    }
+
+    // Position in pixels
+    sf::Vector2f getPos() const { return mSprite.getPosition(); }
+
+    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const
+    {
+        target.draw(mSprite, states);
+    }
+};
+
+#endif /* CHARACTER_SPRITE_HPP */
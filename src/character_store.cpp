@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <vector>
+#include <SFML/System.hpp>
+
+#include "character_store.hpp"
+#include "vecmath.hpp"
+
+const EntityHandle CharacterStore::invalid = { 0xffffffff, 0 };
+
+// Move the last element into i and drop the last
+template<typename T>
+static void swapRemove(std::vector<T>& v, size_t i)
+{
+    v[i] = v.back();
+    v.pop_back();
+}
+
+EntityHandle CharacterStore::add(sf::Uint32 entityId, const Creature& c, const sf::Vector2f& p)
+{
+    sf::Uint32 index;
+    if(!mFree.empty())
+    {
+        index = mFree.back();
+        mFree.pop_back();
+    }
+    else
+    {
+        index = mSlots.size();
+        mSlots.push_back((Slot){ 0, 0, false });
+    }
+    Slot& slot = mSlots[index];
+    slot.dense = pos.size();
+    slot.used = true;
+    mSlotOf.push_back(index);
+
+    id.push_back(entityId);
+    pos.push_back(p);
+    vel.push_back(sf::Vector2f());
+    waypoint.push_back(p);
+    arriveDistance.push_back(0.01f);
+    onPath.push_back(false);
+    moveSpeed.push_back(c.moveSpeed);
+    hp.push_back(c.hp);
+    hpMax.push_back(c.hp_max);
+    hpRegen.push_back(c.hp_regen);
+    mp.push_back(c.mp);
+    mpMax.push_back(c.mp_max);
+    mpRegen.push_back(c.mp_regen);
+    stats.push_back(c.stats);
+    if(!history.empty()) history.push_back(PositionHistory());
+    if(!interp.empty()) interp.push_back(InterpolationBuffer());
+
+    return (EntityHandle){ index, slot.generation };
+}
+
+void CharacterStore::remove(EntityHandle h)
+{
+    int i = index(h);
+    if(i < 0) return;
+    // Whoever is last takes the removed entity's place
+    mSlots[mSlotOf.back()].dense = i;
+    swapRemove(mSlotOf, i);
+    swapRemove(id, i);
+    swapRemove(pos, i);
+    swapRemove(vel, i);
+    swapRemove(waypoint, i);
+    swapRemove(arriveDistance, i);
+    swapRemove(onPath, i);
+    swapRemove(moveSpeed, i);
+    swapRemove(hp, i);
+    swapRemove(hpMax, i);
+    swapRemove(hpRegen, i);
+    swapRemove(mp, i);
+    swapRemove(mpMax, i);
+    swapRemove(mpRegen, i);
+    swapRemove(stats, i);
+    if(!history.empty()) swapRemove(history, i);
+    if(!interp.empty()) swapRemove(interp, i);
+
+    Slot& slot = mSlots[h.index];
+    slot.used = false;
+    ++slot.generation;
+    mFree.push_back(h.index);
+}
+
+int CharacterStore::index(EntityHandle h) const
+{
+    if(h.index >= mSlots.size()) return -1;
+    const Slot& slot = mSlots[h.index];
+    if(!slot.used || slot.generation != h.generation) return -1;
+    return slot.dense;
+}
+
+void CharacterStore::update(float dt, std::vector<size_t>& arrived)
+{
+    const size_t n = size();
+    // Same steering as PathfindingHelper::update, so the client's
+    // prediction replays it exactly
+    for(size_t i = 0; i < n; ++i)
+    {
+        sf::Vector2f v = waypoint[i] - pos[i];
+        float norm = vecmath::norm(v);
+        vel[i] = norm > arriveDistance[i] ? v / norm * moveSpeed[i] : sf::Vector2f();
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        pos[i] += vel[i] * dt;
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(onPath[i] && vecmath::norm(pos[i] - waypoint[i]) < 0.1f) arrived.push_back(i);
+    }
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(hp[i] < hpMax[i]) hp[i] = std::min(hpMax[i], hp[i] + hpRegen[i] * dt);
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(mp[i] < mpMax[i]) mp[i] = std::min(mpMax[i], mp[i] + mpRegen[i] * dt);
+    }
+}
+
+void CharacterStore::record(float t)
+{
+    const size_t n = size();
+    history.resize(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        history[i].push(t, pos[i]);
+    }
+}
+
+void CharacterStore::interpolate(float t)
+{
+    const size_t n = interp.size();
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(interp[i].empty()) continue;
+        pos[i] = interp[i].sample(t);
+        steer(i, pos[i], 0.01f, false);
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef CHARACTER_STORE_HPP
+#define CHARACTER_STORE_HPP
+
+#include <vector>
+#include <SFML/System.hpp>
+
+#include "creature.hpp"
+#include "position_history.hpp"
+#include "interpolation_buffer.hpp"
+
+// Stable reference to an entity in a CharacterStore. Slots are reused
+// once an entity is removed, so the generation is bumped each time to
+// make old handles to the slot stop working
+struct EntityHandle
+{
+    sf::Uint32 index;
+    sf::Uint32 generation;
+
+    bool operator==(const EntityHandle& h) const
+    {
+        return index == h.index && generation == h.generation;
+    }
+    bool operator!=(const EntityHandle& h) const { return !(*this == h); }
+};
+
+// The state of each character which the simulation touches every
+// tick, kept as one dense array per field instead of inside each
+// Character, so moving and regenerating everything are straight loops
+// over contiguous memory. Removing an entity moves the last one into
+// its place, so keep a handle and look up where it is with index.
+// Entities are named by a 32 bit id rather than a charId, so a store
+// isn't limited to the 255 characters the network can address
+class CharacterStore
+{
+public:
+
+    static const EntityHandle invalid;
+
+    // Indexed from 0 to size()-1. Positions are in tiles
+    std::vector<sf::Uint32> id;
+    std::vector<sf::Vector2f> pos;
+    std::vector<sf::Vector2f> vel;
+    // Where each entity is heading and how close counts as there, and
+    // whether that's a node part way along a path or the end of it
+    std::vector<sf::Vector2f> waypoint;
+    std::vector<float> arriveDistance;
+    std::vector<sf::Uint8> onPath;
+    std::vector<float> moveSpeed;
+    std::vector<float> hp;
+    std::vector<float> hpMax;
+    std::vector<float> hpRegen;
+    std::vector<float> mp;
+    std::vector<float> mpMax;
+    std::vector<float> mpRegen;
+    std::vector<Stats> stats;
+    // Where each entity has been, for looking at the game as a client
+    // saw it. Only the server records this, so it's empty until record
+    // is first called, and then kept the same size as everything else
+    std::vector<PositionHistory> history;
+    // Positions heard from the server for entities someone else is
+    // controlling. Only clients interpolate, so this is empty until
+    // heard is first called, the same as history
+    std::vector<InterpolationBuffer> interp;
+
+private:
+
+    struct Slot
+    {
+        sf::Uint32 dense;
+        sf::Uint32 generation;
+        bool used;
+    };
+
+    std::vector<Slot> mSlots;
+    std::vector<sf::Uint32> mFree;
+    // Slot owning each dense index
+    std::vector<sf::Uint32> mSlotOf;
+
+public:
+
+    // Add an entity standing still at pos, starting with the
+    // creature's stats
+    EntityHandle add(sf::Uint32 id, const Creature& c, const sf::Vector2f& p);
+    void remove(EntityHandle h);
+
+    // Dense index of the entity, or -1 if the handle is stale
+    int index(EntityHandle h) const;
+    size_t size() const { return pos.size(); }
+
+    // Head somewhere new
+    void steer(size_t i, const sf::Vector2f& target, float distance, bool isPathNode)
+    {
+        waypoint[i] = target;
+        arriveDistance[i] = distance;
+        onPath[i] = isPathNode;
+    }
+
+    // Move everything towards its waypoint and regenerate hp and mp.
+    // Entities which have reached a path node are added to arrived, by
+    // index, so they can be steered towards the next one
+    void update(float dt, std::vector<size_t>& arrived);
+
+    // Entity i was at p as of time t
+    void heard(size_t i, float t, const sf::Vector2f& p)
+    {
+        interp.resize(size());
+        interp[i].push(t, p);
+    }
+    // Move every entity that has been heard about to where it was at
+    // time t, and stop it moving on its own
+    void interpolate(float t);
+
+    // Add where everything is now to its history
+    void record(float t);
+    // Where entity i was at time t, or is now if nothing was recorded
+    sf::Vector2f pastPos(size_t i, float t) const
+    {
+        if(history.empty() || history[i].empty()) return pos[i];
+        return history[i].sample(t);
+    }
+};
+
+#endif /* CHARACTER_STORE_HPP */
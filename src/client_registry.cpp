@@ -0,0 +1,82 @@
+#include <vector>
+#include <unordered_map>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "client_registry.hpp"
+#include "network_manager.hpp"
+
+const ClientHandle ClientRegistry::invalid = { 0xffffffff, 0 };
+
+ClientHandle ClientRegistry::add(const Client& client)
+{
+    sf::Uint32 index;
+    if(!mFree.empty())
+    {
+        index = mFree.back();
+        mFree.pop_back();
+    }
+    else
+    {
+        index = mSlots.size();
+        mSlots.push_back((Slot){ client, 0, false });
+    }
+    Slot& slot = mSlots[index];
+    slot.client = client;
+    slot.used = true;
+    ClientHandle h = handle(index);
+
+    mByAddress[addressKey(client.ip, client.port)] = index;
+    if(client.charId != 255) mByKey[clientKey(client.gameId, client.charId)] = index;
+
+    return h;
+}
+
+void ClientRegistry::remove(ClientHandle h)
+{
+    if(get(h) == nullptr) return;
+    Slot& slot = mSlots[h.index];
+    const Client& client = slot.client;
+
+    mByAddress.erase(addressKey(client.ip, client.port));
+    if(client.charId != 255) mByKey.erase(clientKey(client.gameId, client.charId));
+
+    slot.used = false;
+    ++slot.generation;
+    mFree.push_back(h.index);
+}
+
+void ClientRegistry::setCharId(ClientHandle h, sf::Uint8 charId)
+{
+    if(get(h) == nullptr) return;
+    Client& client = mSlots[h.index].client;
+    if(client.charId != 255) mByKey.erase(clientKey(client.gameId, client.charId));
+    client.charId = charId;
+    if(charId != 255) mByKey[clientKey(client.gameId, charId)] = h.index;
+}
+
+const ClientRegistry::Client* ClientRegistry::get(ClientHandle h) const
+{
+    if(h.index >= mSlots.size()) return nullptr;
+    const Slot& slot = mSlots[h.index];
+    if(!slot.used || slot.generation != h.generation) return nullptr;
+    return &slot.client;
+}
+
+ClientHandle ClientRegistry::at(sf::Uint32 index) const
+{
+    if(index >= mSlots.size() || !mSlots[index].used) return invalid;
+    return handle(index);
+}
+
+ClientHandle ClientRegistry::find(const sf::IpAddress& ip, sf::Uint16 port) const
+{
+    auto it = mByAddress.find(addressKey(ip, port));
+    return it == mByAddress.end() ? invalid : handle(it->second);
+}
+
+ClientHandle ClientRegistry::find(sf::Uint16 gameId, sf::Uint8 charId) const
+{
+    auto it = mByKey.find(clientKey(gameId, charId));
+    return it == mByKey.end() ? invalid : handle(it->second);
+}
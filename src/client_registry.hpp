@@ -0,0 +1,86 @@
+#ifndef CLIENT_REGISTRY_HPP
+#define CLIENT_REGISTRY_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+// Stable reference to a connected client. Slots are reused once a
+// client leaves, so the generation is bumped each time to make old
+// handles to the slot stop working
+struct ClientHandle
+{
+    sf::Uint32 index;
+    sf::Uint32 generation;
+
+    bool operator==(const ClientHandle& h) const
+    {
+        return index == h.index && generation == h.generation;
+    }
+    bool operator!=(const ClientHandle& h) const { return !(*this == h); }
+};
+
+// Every client connected to the server, with hash indices on address
+// and on (gameId, charId) so finding a client is O(1). The members of
+// each game are kept by the game's worker (see ServerGame)
+class ClientRegistry
+{
+public:
+
+    struct Client
+    {
+        sf::IpAddress ip;
+        sf::Uint16 port;
+        sf::Uint16 gameId;
+        sf::Uint8 charId; // 255 until the game has accepted them
+    };
+
+    static const ClientHandle invalid;
+
+private:
+
+    struct Slot
+    {
+        Client client;
+        sf::Uint32 generation;
+        bool used;
+    };
+
+    std::vector<Slot> mSlots;
+    std::vector<sf::Uint32> mFree;
+    std::unordered_map<sf::Uint64, sf::Uint32> mByAddress;
+    std::unordered_map<sf::Uint32, sf::Uint32> mByKey;
+
+    static sf::Uint64 addressKey(const sf::IpAddress& ip, sf::Uint16 port)
+    {
+        return (sf::Uint64(ip.toInteger()) << 16) | port;
+    }
+
+    ClientHandle handle(sf::Uint32 index) const
+    {
+        return (ClientHandle){ index, mSlots[index].generation };
+    }
+
+public:
+
+    // Add a client, which should not already be present
+    ClientHandle add(const Client& client);
+    void remove(ClientHandle h);
+
+    // Set the character slot a client was given by their game
+    void setCharId(ClientHandle h, sf::Uint8 charId);
+
+    // Return nullptr if the handle is stale
+    const Client* get(ClientHandle h) const;
+
+    // Handle to whoever is in a slot, or invalid if it's free
+    ClientHandle at(sf::Uint32 index) const;
+
+    ClientHandle find(const sf::IpAddress& ip, sf::Uint16 port) const;
+    ClientHandle find(sf::Uint16 gameId, sf::Uint8 charId) const;
+
+    size_t size() const { return mByAddress.size(); }
+};
+
+#endif /* CLIENT_REGISTRY_HPP */
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "connection.hpp"
+
+Connection::Connection() :
+    mLocalSequence(0),
+    mRemoteSequence(0),
+    mReceivedBits(0),
+    mReceivedAny(false),
+    mNeedsAck(false),
+    mReceived(window, -1),
+    mSent(window, (Sent){ -1, sf::Time::Zero, false, false }),
+    mRtt(0.1f),
+    mRttVar(0.05f),
+    mRttSampled(false),
+    mDropped(0),
+    mLossCheck(0),
+    mLoss(0.0f),
+    mLost(0),
+    mLastActive(sf::Time::Zero),
+    mAnswered(false)
+{
+}
+
+// Header is [sequence][newest sequence received][ack bits][late ack],
+// where bit i of the ack bits is set if we've received newest - i. Until
+// we've received anything the ack bits are all clear. The late ack is a
+// packet received too late for the ack bits, or the newest again if
+// there is none
+void Connection::writeHeader(sf::Packet& packet, sf::Uint16 sequence)
+{
+    sf::Uint16 late = mRemoteSequence;
+    if(!mLateAcks.empty())
+    {
+        late = mLateAcks.front();
+        mLateAcks.pop_front();
+    }
+    packet << sequence << mRemoteSequence << mReceivedBits << late;
+    // Any more still need sending, even with nothing else to say
+    mNeedsAck = !mLateAcks.empty();
+}
+
+void Connection::acked(sf::Uint16 sequence, sf::Time now)
+{
+    mPending.erase(sequence);
+    Sent& sent = mSent[sequence % window];
+    if(sent.sequence != sequence || sent.acked) return;
+    sent.acked = true;
+    mLoss *= 0.95f;
+
+    // Can't tell which copy of a resent packet was acked, so only
+    // measure from packets sent once (Karn's algorithm)
+    if(sent.resent) return;
+    float sample = (now - sent.time).asSeconds();
+    if(!mRttSampled)
+    {
+        mRtt = sample;
+        mRttVar = sample / 2.0f;
+        mRttSampled = true;
+    }
+    else
+    {
+        mRttVar = 0.75f * mRttVar + 0.25f * std::fabs(mRtt - sample);
+        mRtt = 0.875f * mRtt + 0.125f * sample;
+    }
+}
+
+void Connection::checkLoss(sf::Uint16 oldestAckable)
+{
+    // Acks from a packet which arrived out of order tell us nothing new
+    if(!newer(oldestAckable, mLossCheck)) return;
+    // Anything further back than the window has been forgotten anyway
+    if(sf::Uint16(oldestAckable - mLossCheck) > window) mLossCheck = oldestAckable - window;
+    for(; mLossCheck != oldestAckable; ++mLossCheck)
+    {
+        const Sent& sent = mSent[mLossCheck % window];
+        if(sent.sequence != mLossCheck || sent.acked) continue;
+        mLoss = 0.95f * mLoss + 0.05f;
+        ++mLost;
+    }
+}
+
+sf::Packet Connection::wrap(const sf::Packet& body, bool reliable, sf::Time now)
+{
+    sf::Uint16 sequence = mLocalSequence++;
+    mLastActive = now;
+    sf::Packet packet;
+    writeHeader(packet, sequence);
+    packet.append(body.getData(), body.getDataSize());
+
+    mSent[sequence % window] = (Sent){ sequence, now, false, false };
+    if(reliable) mPending[sequence] = (Pending){ body, now, 0 };
+
+    return packet;
+}
+
+bool Connection::unwrap(sf::Packet& packet, sf::Time now,
+    bool& duplicate, sf::Uint16& sequence)
+{
+    sequence = 0;
+    sf::Uint16 ack = 0;
+    sf::Uint32 ackBits = 0;
+    sf::Uint16 late = 0;
+    if(!(packet >> sequence >> ack >> ackBits >> late)) return false;
+    mLastActive = now;
+
+    // Whatever the packet holds, its acks are still good
+    for(unsigned int i = 0; i < 32; ++i)
+    {
+        if(ackBits & (sf::Uint32(1) << i)) acked(ack - i, now);
+    }
+    if(ackBits != 0) checkLoss(ack - 31);
+    // With nothing late to ack the newest is repeated, which the ack
+    // bits already cover, or which hasn't arrived if they're clear
+    if(late != ack) acked(late, now);
+
+    duplicate = mReceived[sequence % window] == sequence;
+    if(duplicate)
+    {
+        // Another copy of a late packet means its ack went missing
+        if(sf::Uint16(mRemoteSequence - sequence) >= 32 && mLateAcks.size() < maxLateAcks)
+        {
+            mLateAcks.push_back(sequence);
+            mNeedsAck = true;
+        }
+        return true;
+    }
+    mReceived[sequence % window] = sequence;
+
+    if(!mReceivedAny || newer(sequence, mRemoteSequence))
+    {
+        sf::Uint16 shift = mReceivedAny ? sf::Uint16(sequence - mRemoteSequence) : 32;
+        mReceivedBits = shift >= 32 ? 0 : mReceivedBits << shift;
+        mReceivedBits |= 1;
+        mRemoteSequence = sequence;
+        mReceivedAny = true;
+    }
+    else
+    {
+        sf::Uint16 age = mRemoteSequence - sequence;
+        if(age < 32) mReceivedBits |= sf::Uint32(1) << age;
+        // Otherwise the sender would never hear it arrived, and would
+        // resend it until it gave up
+        else if(mLateAcks.size() < maxLateAcks) mLateAcks.push_back(sequence);
+    }
+    mNeedsAck = true;
+
+    return true;
+}
+
+bool Connection::supersedes(sf::Uint16 stream, sf::Uint16 sequence)
+{
+    auto it = mNewest.find(stream);
+    // Anything further back than the window is from long enough ago
+    // that the sequence has probably wrapped since
+    if(it != mNewest.end() && newer(it->second, sequence) &&
+        sf::Uint16(it->second - sequence) < window)
+    {
+        return false;
+    }
+    mNewest[stream] = sequence;
+    return true;
+}
+
+std::vector<sf::Packet> Connection::resends(sf::Time now)
+{
+    std::vector<sf::Packet> packets;
+    // Retransmission timeout as in TCP, kept between 50ms and 1s
+    float timeout = std::min(std::max(mRtt + 4.0f * mRttVar, 0.05f), 1.0f);
+
+    for(auto it = mPending.begin(); it != mPending.end();)
+    {
+        Pending& pending = it->second;
+        // Back off exponentially so a dead link isn't flooded
+        float wait = timeout * float(1 << std::min(pending.resends, 4u));
+        if((now - pending.sentAt).asSeconds() < wait)
+        {
+            ++it;
+            continue;
+        }
+        if(pending.resends >= maxResends)
+        {
+            ++mDropped;
+            it = mPending.erase(it);
+            continue;
+        }
+
+        // Same sequence number, but with the latest acks
+        sf::Packet packet;
+        writeHeader(packet, it->first);
+        packet.append(pending.body.getData(), pending.body.getDataSize());
+        packets.push_back(packet);
+
+        pending.sentAt = now;
+        ++pending.resends;
+        Sent& sent = mSent[it->first % window];
+        if(sent.sequence == it->first) sent.resent = true;
+        ++it;
+    }
+
+    return packets;
+}
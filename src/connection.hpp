@@ -0,0 +1,136 @@
+#ifndef CONNECTION_HPP
+#define CONNECTION_HPP
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+// Reliability state for one address the NetworkManager talks to.
+// Every packet sent is numbered and carries acks for the last 32
+// packets received from the other end, plus one for a packet which
+// arrived too far behind the others to fit, so packets holding reliable
+// events can be resent until they are acked, duplicates of resent
+// packets can be dropped, and the round trip time can be measured
+// without sending anything extra
+class Connection
+{
+private:
+
+    struct Sent
+    {
+        sf::Int32 sequence;
+        sf::Time time;
+        bool acked;
+        bool resent;
+    };
+
+    struct Pending
+    {
+        sf::Packet body;
+        sf::Time sentAt;
+        unsigned int resends;
+    };
+
+    static const unsigned int window = 1024;
+    static const unsigned int maxResends = 10;
+
+    sf::Uint16 mLocalSequence;
+    sf::Uint16 mRemoteSequence;
+    sf::Uint32 mReceivedBits;
+    bool mReceivedAny;
+    bool mNeedsAck;
+    // Packets received too long after newer ones for the ack bits to
+    // reach, acked one per packet sent. Usually resends
+    std::deque<sf::Uint16> mLateAcks;
+    static const size_t maxLateAcks = 64;
+
+    // Recently received and sent packets, indexed by sequence modulo
+    // window. -1 marks an empty entry
+    std::vector<sf::Int32> mReceived;
+    std::vector<Sent> mSent;
+    // Reliable packets which haven't been acked yet
+    std::map<sf::Uint16, Pending> mPending;
+
+    float mRtt;
+    float mRttVar;
+    bool mRttSampled;
+    sf::Uint64 mDropped;
+
+    // Packets are known to be lost once they fall out of the range the
+    // other end's ack bits cover without being acked. Everything before
+    // mLossCheck has been checked
+    sf::Uint16 mLossCheck;
+    float mLoss;
+    sf::Uint64 mLost;
+
+    // When anything was last sent or received, so connections which
+    // have gone quiet can be forgotten
+    sf::Time mLastActive;
+    // Whether we've sent anything other than acks
+    bool mAnswered;
+
+    // Sequence of the newest packet received on each stream of
+    // unreliable events, which supersede only their own kind
+    std::map<sf::Uint16, sf::Uint16> mNewest;
+
+    // Sequence numbers wrap, so compare them modulo 2^16
+    static bool newer(sf::Uint16 a, sf::Uint16 b)
+    {
+        return static_cast<sf::Int16>(a - b) > 0;
+    }
+
+    void writeHeader(sf::Packet& packet, sf::Uint16 sequence);
+    void acked(sf::Uint16 sequence, sf::Time now);
+    void checkLoss(sf::Uint16 oldestAckable);
+
+public:
+
+    // Bytes wrap puts in front of each body
+    static const size_t headerSize = 10;
+
+    Connection();
+
+    // Number a packet and add acks to it. Reliable packets are kept
+    // until they are acked
+    sf::Packet wrap(const sf::Packet& body, bool reliable, sf::Time now);
+
+    // Read the header of an incoming packet, leaving the body to be
+    // read. Sets duplicate if we've had this packet before, and
+    // sequence to the packet's number. Returns false if the header is
+    // malformed
+    bool unwrap(sf::Packet& packet, sf::Time now, bool& duplicate, sf::Uint16& sequence);
+
+    // True if nothing more recent than this packet has arrived on the
+    // given stream, in which case it becomes the newest
+    bool supersedes(sf::Uint16 stream, sf::Uint16 sequence);
+
+    // Reliable packets which have gone unacked for too long. Packets
+    // which have been resent too many times are given up on
+    std::vector<sf::Packet> resends(sf::Time now);
+
+    // True if we've received something since we last sent anything,
+    // so the other end is waiting on an ack
+    bool needsAck() const { return mNeedsAck; }
+
+    sf::Time lastActive() const { return mLastActive; }
+
+    // Until we send the other end something besides acks, it's a
+    // stranger which opened the connection itself, and we needn't keep
+    // it long
+    void answer() { mAnswered = true; }
+    bool answered() const { return mAnswered; }
+
+    // Smoothed round trip time in seconds
+    float rtt() const { return mRtt; }
+    // Reliable packets given up on
+    sf::Uint64 dropped() const { return mDropped; }
+    // Fraction of recent packets which were never acked
+    float loss() const { return mLoss; }
+    sf::Uint64 lost() const { return mLost; }
+    // Reliable packets still waiting on an ack
+    size_t pending() const { return mPending.size(); }
+};
+
+#endif /* CONNECTION_HPP */
@@ -6,4 +6,6 @@ const unsigned int ld::heightTiles = 15;
 const unsigned int ld::widthTiles = ld::width / ((float)ld::height / ld::heightTiles);
 const char* ld::title = "minild66";
 const float ld::cameraPanSpeed = 6.0f;
+const float ld::attackRange = 1.0f;
+const float ld::clickRadius = 0.4f;
 bool ld::isServer = false;
@@ -10,6 +10,10 @@ extern unsigned int width;
 extern unsigned int height;
 extern const char* title;
 extern const float cameraPanSpeed;
+// Auto attacks reach attackRange tiles. A click within clickRadius
+// tiles of a character counts as clicking on them
+extern const float attackRange;
+extern const float clickRadius;
 extern bool isServer;
 }
 
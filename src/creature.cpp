@@ -38,11 +38,6 @@ void Creature::load(const JsonBox::Value& v, EntityManager* mgr)
     {
         mTileset = mgr->getEntity<Tileset>(o["tileset"].tryGetString("nullid"));
         mTs = mTileset->tilesize;
-        mSprite.setTexture(mTileset->tex);
-        mAnim = &mTileset->animations[id + "_idle_n"];
-        mSprite.setTextureRect(sf::IntRect(mAnim->x, mAnim->y, mTs, mTs));
-        mAnimT = 0.0f;
-        mAnimCurrentFrame = 0;
-        mSprite.setOrigin(mTs/2.0, mTs/2.0);
+        mIdleAnim = &mTileset->animations[id + "_idle_n"];
     }
 }
@@ -3,7 +3,6 @@
 
 #include <JsonBox.h>
 #include <string>
-#include <SFML/Graphics.hpp>
 #include <SFML/System.hpp>
 
 #include "entity.hpp"
@@ -27,7 +26,11 @@ typedef struct
     float lck;
 } Stats;
 
-class Creature : public Entity, public sf::Drawable
+// What every creature of one kind has in common, loaded once by the
+// EntityManager and shared by every instance of it. Nothing here
+// changes once loaded; each game keeps what does change in its
+// CharacterStore, and the client draws each one with a CharacterSprite
+class Creature : public Entity
 {
 public:
     // Health
@@ -50,57 +53,30 @@ public:
     float sa;
 
 protected:
-    // TODO: Add these to a component instead of just hacking them in?
-    sf::Vector2f mPos;
-    sf::Vector2f mVel;
-    sf::Sprite mSprite;
     Tileset* mTileset;
     unsigned int mTs;
-    Animation* mAnim;
-    float mAnimT;
-    unsigned int mAnimCurrentFrame;
+    // Looked up once here rather than by every instance
+    Animation* mIdleAnim;
 
 public:
 
-    Creature() : Entity("nullid") {}
+    Creature() : Entity("nullid"), mTileset(nullptr), mTs(0), mIdleAnim(nullptr) {}
     Creature(const std::string& id, const JsonBox::Value& v, EntityManager* mgr) :
-        Entity(id)
+        Entity(id),
+        mTileset(nullptr),
+        mTs(0),
+        mIdleAnim(nullptr)
     {
         load(v, mgr);
     }
 
     virtual void load(const JsonBox::Value& v, EntityManager* mgr);
 
-    virtual void update(float dt)
-    {
-        mAnimT += dt;
-        mSprite.setPosition(mPos);
-        int frame = mAnimT * mAnim->len / mAnim->duration;
-        if(frame >= mAnim->len) frame %= mAnim->len;
-        // No point changing the frame when it doesn't need to be
-        if(frame != mAnimCurrentFrame)
-        {
-            mSprite.setTextureRect(sf::IntRect(
-                    mAnim->x + frame * mTs,
-                    mAnim->y,
-                    mTs,
-                    mTs));
-            mAnimCurrentFrame = frame;
-        }
-    }
-
-    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const
-    {
-        target.draw(mSprite);
-    }
-
-    virtual void setPos(const sf::Vector2f& pos)
-    {
-        mPos = pos;
-        mSprite.setPosition(mPos);
-    }
+    // Null if the creature has no tileset
+    Tileset* getTileset() const { return mTileset; }
+    unsigned int getTilesize() const { return mTs; }
+    const Animation* getIdleAnimation() const { return mIdleAnim; }
 
-    virtual sf::Vector2f getPos() const { return mPos; }
     virtual float getMoveSpeed() const { return moveSpeed; }
 };
 
@@ -1,4 +1,6 @@
 #include <string>
+#include <tuple>
+#include <utility>
 #include <SFML/System.hpp>
 
 #include "game_container.hpp"
@@ -35,28 +37,56 @@ bool GameContainer::add(const std::string& characterId,
     }
     if(assignedTeam == Team::None) return false;
 
-    // If on the server, add to the next available slot
+    // If on the server, add to the lowest free slot. Slots are freed
+    // when players leave, so there may be gaps
     if(*charId == 255 || characters.count(*charId) > 0)
-        *charId = characters.size();
+    {
+        *charId = 0;
+        while(characters.count(*charId) > 0) ++*charId;
+    }
 
-    CharWrapper character(characterId, assignedTeam, mgr);
     // Calculate their starting position
     // TODO: Do this with proper spawns
-    sf::Vector2f startPos = (assignedTeam == Team::One ? 
-    	map->team1Spawns[*charId] : map->team2Spawns[*charId]);
-   
-    character.c.pfHelper = PathfindingHelper(startPos, startPos, &map->graph);
-    character.c.setPos(startPos);
-    characters[*charId] = character;
+    const std::vector<sf::Vector2f>& spawns = (assignedTeam == Team::One ?
+        map->team1Spawns : map->team2Spawns);
+    sf::Uint8 teamCount = (assignedTeam == Team::One ? team1Count : team2Count);
+    sf::Vector2f startPos = spawns[teamCount % spawns.size()];
+
+    // Built in place, since the slot is known to be free
+    CharWrapper& character = characters.emplace(std::piecewise_construct,
+        std::forward_as_tuple(*charId),
+        std::forward_as_tuple(characterId, assignedTeam, mgr)).first->second;
+    character.pfHelper = PathfindingHelper(startPos, startPos, &map->graph);
+#ifndef LD_HEADLESS
+    character.sprite.place(startPos);
+#endif
+    character.entity = store.add(*charId, *character.proto, startPos);
 
     return true;
 }
 
+void GameContainer::remove(sf::Uint8 charId)
+{
+    auto it = characters.find(charId);
+    if(it == characters.end()) return;
+    store.remove(it->second.entity);
+    characters.erase(it);
+}
+
 void GameContainer::update(float dt)
 {
-    for(auto& ch : characters)
+    time += dt;
+    mArrived.clear();
+    store.update(dt, mArrived);
+    // Only those which have reached a node need their path looking at
+    for(auto i : mArrived)
     {
-        ch.second.c.update(dt);
+        auto it = characters.find(static_cast<sf::Uint8>(store.id[i]));
+        if(it == characters.end()) continue;
+        PathfindingHelper& pfHelper = it->second.pfHelper;
+        pfHelper.pos = store.pos[i];
+        pfHelper.reached();
+        store.steer(i, pfHelper.waypoint(), pfHelper.arriveDistance(), pfHelper.onPath());
     }
     // Shitty way of deleting finished events
     // No time or inclination right now for a proper solution
@@ -69,3 +99,38 @@ void GameContainer::update(float dt)
         }
     }
 }
+
+#ifndef LD_HEADLESS
+void GameContainer::animate(float dt)
+{
+    for(auto& ch : characters)
+    {
+        ch.second.sprite.place(store.pos[store.index(ch.second.entity)]);
+        ch.second.sprite.update(dt);
+    }
+}
+#endif
+
+void GameContainer::setPos(sf::Uint8 charId, const sf::Vector2f& pos)
+{
+    size_t i = indexOf(charId);
+    store.pos[i] = pos;
+    characters[charId].pfHelper.pos = pos;
+}
+
+void GameContainer::setTarget(sf::Uint8 charId, const sf::Vector2f& target)
+{
+    size_t i = indexOf(charId);
+    PathfindingHelper& pfHelper = characters[charId].pfHelper;
+    pfHelper.pos = store.pos[i];
+    pfHelper.setTarget(target);
+    store.steer(i, pfHelper.waypoint(), pfHelper.arriveDistance(), pfHelper.onPath());
+}
+
+void GameContainer::sync(sf::Uint8 charId)
+{
+    size_t i = indexOf(charId);
+    const PathfindingHelper& pfHelper = characters[charId].pfHelper;
+    store.pos[i] = pfHelper.pos;
+    store.steer(i, pfHelper.waypoint(), pfHelper.arriveDistance(), pfHelper.onPath());
+}
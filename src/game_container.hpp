@@ -10,6 +10,12 @@
 #include "game_map.hpp"
 #include "character.hpp"
 #include "entity_manager.hpp"
+#include "move_prediction.hpp"
+#include "character_store.hpp"
+#include "pathfinding_helper.hpp"
+#ifndef LD_HEADLESS
+#include "character_sprite.hpp"
+#endif
 
 class TargetAttack;
 
@@ -28,11 +34,19 @@ public:
     const static sf::Uint8 playersPerTeam = 5;
 
     // Wraps a Character, containing properties relevant only
-    // to this game and not to characters in general
+    // to this game and not to characters in general. Position, hp and
+    // mp are simulated in the game's store
     class CharWrapper
     {
     public:
-        Character c;
+        // Shared by every character of the same kind, and owned by
+        // the EntityManager
+        const Character* proto;
+        EntityHandle entity;
+        PathfindingHelper pfHelper;
+#ifndef LD_HEADLESS
+        CharacterSprite sprite;
+#endif
 
         sf::Uint32 gold;
         sf::Time respawnTimer;
@@ -44,31 +58,52 @@ public:
         bool isPlayer;
 
         CharWrapper(const std::string& characterId, Team team, EntityManager* mgr) :
-            c(*mgr->getEntity<Character>(characterId)),
+            proto(mgr->getEntity<Character>(characterId)),
+            entity(CharacterStore::invalid),
+#ifndef LD_HEADLESS
+            sprite(*proto),
+#endif
             gold(0),
             kills(0),
             assists(0),
             deaths(0),
-            team(team)
+            team(team),
+            isPlayer(false)
         {
         }
 
-        CharWrapper() {}
+        CharWrapper() : proto(nullptr), entity(CharacterStore::invalid), isPlayer(false) {}
     };
 
     GameMap* map;
     std::map<sf::Uint8, CharWrapper> characters;
+    // Hot state of every character, see indexOf
+    CharacterStore store;
     sf::Uint16 gameId;
     sf::Uint8 client;
+    // Seconds simulated so far
+    float time;
+
+    // Orders given to the client's character which the server may
+    // not have seen yet. Unused on the server
+    MovePrediction prediction;
 
     // Attacks being processed
     std::vector<std::shared_ptr<TargetAttack>> targetAttacks;
 
-    GameContainer() {}
+private:
+
+    // Filled by store.update, kept to save allocating every tick
+    std::vector<size_t> mArrived;
+
+public:
+
+    GameContainer() : time(0.0f) {}
     GameContainer(GameMap* map, sf::Uint16 gameId, sf::Uint8 client) :
         map(map),
         gameId(gameId),
-        client(client)
+        client(client),
+        time(0.0f)
     {}
 
     // Return a pointer to the client's character
@@ -84,7 +119,39 @@ public:
     bool add(const std::string& characterId,
         Team team, EntityManager* mgr, sf::Uint8* charId);
 
+    // Free a character's slot so it can be given to someone else
+    void remove(sf::Uint8 charId);
+
     void update(float dt);
+#ifndef LD_HEADLESS
+    // Move each character's sprite to where it is and advance its
+    // animation. Only needed by something drawing the game
+    void animate(float dt);
+#endif
+
+    // Where the character's state is in store. It must exist
+    size_t indexOf(sf::Uint8 charId) const
+    {
+        return store.index(characters.at(charId).entity);
+    }
+
+    // Position in tiles
+    const sf::Vector2f& getPos(sf::Uint8 charId) const { return store.pos[indexOf(charId)]; }
+    void setPos(sf::Uint8 charId, const sf::Vector2f& pos);
+    // Pathfind from where the character is now to target
+    void setTarget(sf::Uint8 charId, const sf::Vector2f& target);
+    const sf::Vector2f& getTarget(sf::Uint8 charId) const
+    {
+        return characters.at(charId).pfHelper.target;
+    }
+    // Take up the position and path of the character's pfHelper,
+    // after it has been moved by something else such as prediction
+    void sync(sf::Uint8 charId);
+
+    // Move every character the server has told us about to where they
+    // were delay seconds ago. Only the store is moved, as nothing uses
+    // the path of a character someone else controls
+    void interpolate(float delay) { store.interpolate(time - delay); }
 };
 
 #endif /* GAME_CONTAINER_HPP */
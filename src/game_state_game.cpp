@@ -36,6 +36,11 @@ void GameStateGame::pan(const sf::Vector2f& dir, float dt, const sf::RenderWindo
 
 void GameStateGame::handleEvent(const sf::Event& event, const sf::RenderWindow& window)
 {
+    if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3)
+    {
+        showOverlay = !showOverlay;
+        return;
+    }
     // Moving / cancelling current action
     if(event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left)
     {
@@ -52,11 +57,11 @@ void GameStateGame::handleEvent(const sf::Event& event, const sf::RenderWindow&
             // Ignore clients on the same team (also ignores self)
             if(ch.second.team == client->team) continue;
             // Check click was close to them
-            if(vecmath::norm(target - ch.second.c.pfHelper.pos) < 0.4)
+            if(vecmath::norm(target - game->getPos(ch.first)) < ld::clickRadius)
             {
                 // If client is sufficiently close, then we're attacking
                 // TODO: Variable attack range
-                if(vecmath::norm(target - client->c.pfHelper.pos) < 1.0)
+                if(vecmath::norm(target - game->getPos(game->client)) < ld::attackRange)
                 {
                     // Send an autoattack event to the server
                     NetworkManager::Event netEvent;
@@ -76,30 +81,40 @@ void GameStateGame::handleEvent(const sf::Event& event, const sf::RenderWindow&
                     // Clicked on a client, so bind their position to
                     // the target
                     staticTarget = false;
-                    pathfindPtr = &game->characters[ch.first].c.pfHelper.pos;
-                    target = *pathfindPtr;
+                    following = ch.first;
+                    target = game->getPos(following);
                     break;
                 }
             }
         }
-        // Did not click on anyone, so null the pathfindPtr and
-        // proceed to the clicked position normally
-        if(staticTarget) pathfindPtr = nullptr;
-
-        // Send to server
-        NetworkManager::Event netEvent;
-        netEvent.type = NetworkManager::Event::Move;
-        netEvent.move = {
-            .gameId = game->gameId,
-            .charId = game->client,
-            .target = target,
-            .pos = client->c.pfHelper.pos
-        };
-        nmgr->send(netEvent);
-        nmgr->sendSelf(netEvent);
+        // Did not click on anyone, so stop following and proceed to
+        // the clicked position normally
+        if(staticTarget) following = 255;
+
+        move(target);
     }
 }
 
+void GameStateGame::move(const sf::Vector2f& target)
+{
+    // Predict the move locally, remembering it in case the server
+    // disagrees with where we were
+    sf::Uint16 sequence = game->prediction.push(target);
+    game->setTarget(game->client, target);
+
+    // Send to server
+    NetworkManager::Event netEvent;
+    netEvent.type = NetworkManager::Event::Move;
+    netEvent.move = {
+        .gameId = game->gameId,
+        .charId = game->client,
+        .target = target,
+        .pos = game->getPos(game->client),
+        .sequence = sequence
+    };
+    nmgr->send(netEvent);
+}
+
 void GameStateGame::handleInput(float dt, const sf::RenderWindow& window)
 {
     // Panning using the keyboard
@@ -156,31 +171,33 @@ void GameStateGame::update(float dt)
             else if(ch.first == game->client) barCol = gui::Color::Green;
             else barCol = gui::Color::Blue;
             characterBars[ch.first] = gui::Bar(mMgr->getEntity<Tileset>("tileset_gui"), barCol, 0.5f);
-            characterBars[ch.first].setFillRatio((float)ch.second.c.hp / (float)ch.second.c.hp_max);
+            size_t i = game->indexOf(ch.first);
+            characterBars[ch.first].setFillRatio(game->store.hp[i] / game->store.hpMax[i]);
         }
         // Set health bar position
-        characterBars[ch.first].setPosition(ch.second.c.getPos() - sf::Vector2f(
+        characterBars[ch.first].setPosition(ch.second.sprite.getPos() - sf::Vector2f(
             characterBars[ch.first].getWidth() / 2.0f,
             game->map->tileset->tilesize));
     }
 
     // If client is following someone, and they've moved away from the
     // pfTarget, change their pfTarget to get them back on track
-    if(pathfindPtr != nullptr && vecmath::manhattan(*pathfindPtr-client->c.pfHelper.target) > 1.0f)
+    if(following != 255 && game->characters.count(following) == 0) following = 255;
+    if(following != 255 &&
+        vecmath::manhattan(game->getPos(following) - game->getTarget(game->client)) > 1.0f)
     {
         // Server needs to know about the change too
-        NetworkManager::Event netEvent;
-        netEvent.type = NetworkManager::Event::Move;
-        netEvent.move = {
-            .gameId = game->gameId,
-            .charId = game->client,
-            .target = *pathfindPtr,
-            .pos = client->c.pfHelper.pos
-        };
-        nmgr->send(netEvent);
-        nmgr->sendSelf(netEvent);
+        move(game->getPos(following));
     }
 
+    game->prediction.advance(dt);
     game->update(dt);
+    game->animate(dt);
+
+    if(showOverlay)
+    {
+        overlay.update(dt, nmgr->getStats(), nmgr->getPeers(),
+            NetworkManager::Event::Count);
+    }
 }
 
@@ -15,6 +15,7 @@
 #include "network_manager.hpp"
 #include "gui.hpp"
 #include "target_attack.hpp"
+#include "network_overlay.hpp"
 
 class GameStateGame : public GameState
 {
@@ -22,12 +23,20 @@ private:
     sf::View view;
     std::shared_ptr<GameContainer> game;
     GameContainer::CharWrapper* client;
-    sf::Vector2f* pathfindPtr;
+    // Character the client is chasing, or 255. Positions move about
+    // in the game's store, so keep the id rather than a pointer
+    sf::Uint8 following;
     NetworkManager* nmgr;
     std::map<sf::Uint8, gui::Bar> characterBars;
+    // Toggled with F3
+    NetworkOverlay overlay;
+    bool showOverlay;
 
     void pan(const sf::Vector2f& dir, float dt, const sf::RenderWindow& window);
 
+    // Move the client's character straight away, and tell the server
+    void move(const sf::Vector2f& target);
+
 public:
     GameStateGame(std::shared_ptr<GameState>& state,
             std::shared_ptr<GameState>& prevState,
@@ -36,8 +45,9 @@ public:
             NetworkManager* nmgr) :
         GameState(state, prevState, mgr),
         game(game),
-        pathfindPtr(nullptr),
-        nmgr(nmgr)
+        following(255),
+        nmgr(nmgr),
+        showOverlay(false)
     {
         view = sf::View(sf::FloatRect(0, 0,
             ld::widthTiles * game->map->tilemap.ts,
@@ -47,7 +57,7 @@ public:
         client = game->getClient();
 
         // Centre the view on the client
-        view.setCenter((float)game->map->tilemap.ts * client->c.pfHelper.pos);
+        view.setCenter((float)game->map->tilemap.ts * game->getPos(game->client));
     }
 
     virtual void handleEvent(const sf::Event& event,
@@ -62,13 +72,18 @@ public:
         target.draw(game->map->tilemap, states);
         for(const auto& ch : game->characters)
         {
-            target.draw(ch.second.c, states);
+            target.draw(ch.second.sprite, states);
             target.draw(characterBars.at(ch.first), states);
         }
         for(const auto& attack : game->targetAttacks)
         {
             target.draw(*attack, states);
         }
+        if(showOverlay)
+        {
+            target.setView(target.getDefaultView());
+            target.draw(overlay, states);
+        }
     }
 };
 
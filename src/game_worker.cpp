@@ -0,0 +1,524 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "game_worker.hpp"
+#include "game_container.hpp"
+#include "network_manager.hpp"
+#include "target_attack.hpp"
+#include "join_state.hpp"
+#include "vecmath.hpp"
+#include "constants.hpp"
+
+GameWorker::GameWorker(NetworkManager* nmgr, EntityManager* mgr, const ServerSettings* settings) :
+    mNmgr(nmgr),
+    mMgr(mgr),
+    mSettings(settings),
+    mCoalesced(0),
+    mStarted(false),
+    mKill(false),
+    mTicks(0),
+    mDt(0.0f)
+{
+    mThread = std::thread(&GameWorker::loop, this);
+}
+
+GameWorker::~GameWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mKill = true;
+    }
+    mCv.notify_all();
+    mThread.join();
+}
+
+void GameWorker::push(const NetworkManager::Event& event)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(event.type == NetworkManager::Event::Move)
+    {
+        // Only the newest order matters, so each character costs at
+        // most one pathfind and one broadcast per tick. The older one
+        // is blanked rather than removed so nothing else moves
+        sf::Uint32 key = clientKey(event.move.gameId, event.move.charId);
+        auto it = mMoves.find(key);
+        if(it != mMoves.end())
+        {
+            mInbox[it->second].type = NetworkManager::Event::Nop;
+            ++mCoalesced;
+        }
+        mMoves[key] = mInbox.size();
+    }
+    mInbox.push_back(event);
+}
+
+void GameWorker::start(unsigned int ticks, float dt)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTicks = ticks;
+        mDt = dt;
+        mStarted = true;
+        mMoves.clear();
+    }
+    mCv.notify_all();
+}
+
+void GameWorker::finish()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCv.wait(lock, [this] { return !mStarted; });
+}
+
+void GameWorker::loop()
+{
+    while(true)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCv.wait(lock, [this] { return mStarted || mKill; });
+        if(mKill) return;
+        lock.unlock();
+
+        // Events are applied on the tick boundary, before any ticks run
+        for(auto& e : mInbox) handle(e);
+        mInbox.clear();
+        for(unsigned int t = 0; t < mTicks; ++t)
+        {
+            for(auto& g : mGames) tick(g.second, mDt);
+        }
+
+        lock.lock();
+        mStarted = false;
+        lock.unlock();
+        mCv.notify_all();
+    }
+}
+
+void GameWorker::handle(NetworkManager::Event& netEvent)
+{
+    switch(netEvent.type)
+    {
+        case NetworkManager::Event::Connect:
+            handleConnect(netEvent);
+            break;
+        case NetworkManager::Event::Disconnect:
+            handleDisconnect(netEvent);
+            break;
+        case NetworkManager::Event::Move:
+            handleMove(netEvent);
+            break;
+        case NetworkManager::Event::SnapshotAck:
+            handleSnapshotAck(netEvent);
+            break;
+        case NetworkManager::Event::AutoAttack:
+            handleAutoAttack(netEvent);
+            break;
+        case NetworkManager::Event::Spectate:
+            handleSpectate(netEvent);
+            break;
+        // TODO
+        case NetworkManager::Event::Damage:
+        default:
+            break;
+    }
+}
+
+///////////////////////////////////////////////////
+// CONNECT
+///////////////////////////////////////////////////
+void GameWorker::handleConnect(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.connect;
+    // Replies go to where the Connect came from, not the address the
+    // client wrote in it
+    const sf::IpAddress ip = netEvent.sender;
+    const sf::Uint16 port = netEvent.senderPort;
+    // If the game doesn't exist yet, make it
+    if(mGames.count(e.gameId) == 0)
+    {
+        ServerGame& sg = mGames[e.gameId];
+        sg.game = GameContainer(mMgr->getEntity<GameMap>("gamemap_5v5"), e.gameId, 255);
+        sg.interest = InterestGrid(sg.game.map, mSettings->interestRadius(),
+            mSettings->interestHysteresis, mSettings->interestCellSize);
+    }
+    ServerGame& sg = mGames[e.gameId];
+    GameContainer& game = sg.game;
+    // Attempt to add to a team
+    // TODO: Add team choosing
+    sf::Uint8 charId = 255;
+    if(!game.add("character_fighter", GameContainer::Team::Any, mMgr, &charId))
+    {
+        // Couldn't add, so respond with a failure message
+        NetworkManager::Event response;
+        response.gameFull = {
+            .gameId = e.gameId
+        };
+        response.type = NetworkManager::Event::GameFull;
+        servout << "Game " << e.gameId
+            << " is full, rejecting with message" << std::endl;
+        send(response, ip, port);
+        mJoined.push_back((Joined){ ip, port, e.gameId, charId, false });
+        return;
+    }
+
+    // Added to the team, send a success message to connected clients
+    servout << ip.toString() << ":" << port << " has connected to game "
+        << e.gameId << " as character " << (sf::Uint16)charId << std::endl;
+    game.characters[charId].isPlayer = true;
+    ServerGame::Client& client = sg.addClient(charId);
+    client.ip = ip;
+    client.port = port;
+    client.snapshots = SnapshotHistory();
+    client.snapshotAck = 0;
+    client.priority = PriorityAccumulator();
+    client.movedFrom = game.getPos(charId);
+    client.movedAt = game.time;
+    mJoined.push_back((Joined){ ip, port, e.gameId, charId, true });
+
+    // Send an accept to the client who tried to connect. It still has
+    // the address the client wrote, which is how it knows it's theirs
+    e.team = game.characters[charId].team;
+    e.charId = charId;
+    send(netEvent, ip, port);
+    // Tell the connecting client about everything already in the game,
+    // all in one go however much there is
+    NetworkManager::Event response;
+    response.type = NetworkManager::Event::JoinState;
+    response.joinState = {
+        .gameId = e.gameId
+    };
+    response.state = std::make_shared<JoinState>(game);
+    send(response, ip, port);
+    // Send to other clients who are in the same game. Ip and port are
+    // not needed by other clients, and so are masked
+    e.ip = sf::IpAddress(0, 0, 0, 0);
+    e.port = 0;
+    for(const auto& c : sg.clients)
+    {
+        if(c.charId == charId) continue;
+        send(netEvent, c.ip, c.port);
+        servout << "\tNotified " << c.ip.toString() << ":" << c.port << std::endl;
+    }
+}
+
+///////////////////////////////////////////////////
+// DISCONNECT
+///////////////////////////////////////////////////
+void GameWorker::handleDisconnect(NetworkManager::Event& netEvent)
+{
+    // The server has already checked the client was connected
+    auto& e = netEvent.disconnect;
+    if(mGames.count(e.gameId) == 0) return;
+    ServerGame& sg = mGames[e.gameId];
+    sg.removeClient(e.charId);
+    sg.game.remove(e.charId);
+    // Broadcast
+    e.ip = sf::IpAddress(0, 0, 0, 0);
+    e.port = 0;
+    for(const auto& c : sg.clients)
+    {
+        send(netEvent, c.ip, c.port);
+    }
+    sendSubscribers(sg, netEvent);
+}
+
+///////////////////////////////////////////////////
+// MOVE
+///////////////////////////////////////////////////
+void GameWorker::handleMove(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.move;
+    if(mGames.count(e.gameId) == 0) return;
+    ServerGame& sg = mGames[e.gameId];
+    if(sg.game.characters.count(e.charId) == 0) return;
+    ServerGame::Client* client = sg.getClient(e.charId);
+    if(client == nullptr) return;
+
+    GameContainer& game = sg.game;
+    const sf::Vector2f pos = game.getPos(e.charId);
+    // If the client position is slightly different to server position,
+    // accept the client as truth. If it's wildly different, accept
+    // the server. Clients predict their own movement, so they will
+    // naturally be ahead of the server by however far they could
+    // move in moveTolerance seconds. That allowance is only for
+    // being ahead though, the client still can't have moved faster
+    // than its speed since the last position we took from it
+    bool changeClient = false;
+    float speed = game.store.moveSpeed[game.indexOf(e.charId)];
+    float tolerance = 0.1f + speed * mSettings->moveTolerance;
+    float reach = 0.1f + speed * (game.time - client->movedAt);
+    if(vecmath::norm(pos - e.pos) < tolerance &&
+        vecmath::norm(e.pos - client->movedFrom) <= reach)
+    {
+        game.setPos(e.charId, e.pos);
+    }
+    else
+    {
+        changeClient = true;
+        e.pos = pos;
+    }
+    client->movedFrom = e.pos;
+    client->movedAt = game.time;
+    // Change the target
+    game.setTarget(e.charId, e.target);
+
+    // Now that corrections have been made, broadcast to all clients in
+    // the game, but only broadcast to the sender if they had their
+    // position changed. With snapshots on, everyone else finds out in
+    // the next snapshot instead
+    for(const auto& c : sg.clients)
+    {
+        bool isSender = c.charId == e.charId;
+        if(isSender && !changeClient) continue;
+        if(mSettings->snapshotRate > 0.0f && !isSender) continue;
+        // Nobody needs to know about characters they can't see
+        if(!sg.interest.isInterested(c.charId, e.charId)) continue;
+        send(netEvent, c.ip, c.port);
+    }
+    servlog(Debug, "move") << clientKey(e.gameId, e.charId) << " sent a move event" << std::endl;
+}
+
+///////////////////////////////////////////////////
+// SNAPSHOT ACK
+///////////////////////////////////////////////////
+void GameWorker::handleSnapshotAck(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.snapshotAck;
+    if(mGames.count(e.gameId) == 0) return;
+    ServerGame& sg = mGames[e.gameId];
+    ServerGame::Client* client = sg.getClient(e.charId);
+    if(client == nullptr) return;
+    // Acks can arrive out of order, only the newest is useful as
+    // a baseline
+    if(e.sequence > client->snapshotAck) client->snapshotAck = e.sequence;
+}
+
+///////////////////////////////////////////////////
+// AUTOATTACK
+///////////////////////////////////////////////////
+void GameWorker::handleAutoAttack(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.autoAttack;
+    if(mGames.count(e.gameId) == 0) return;
+    ServerGame& sg = mGames[e.gameId];
+    ServerGame::Client* client = sg.getClient(e.charId);
+    if(client == nullptr) return;
+    GameContainer& game = sg.game;
+    if(game.characters.count(e.charId) == 0 || game.characters.count(e.targetId) == 0) return;
+
+    if(!e.cancel)
+    {
+        // Look at the target where the attacker saw it, rather than
+        // where it is now, so laggy players don't have to lead their
+        // targets. The attacker's own position is predicted, so it is
+        // already up to date
+        float rewind = mNmgr->getRtt(client->ip, client->port) + mSettings->interpolationDelay;
+        rewind = std::min(rewind, mSettings->maxRewind);
+        sf::Vector2f targetPos = game.store.pastPos(game.indexOf(e.targetId), game.time - rewind);
+        const sf::Vector2f& attackerPos = game.getPos(e.charId);
+        float range = ld::attackRange + ld::clickRadius + mSettings->rangeTolerance;
+        if(vecmath::norm(targetPos - attackerPos) > range)
+        {
+            servlog(Debug, "attack") << clientKey(e.gameId, e.charId)
+                << " attacked out of range" << std::endl;
+            // Tell them to stop, since we won't be carrying it out
+            e.cancel = true;
+            send(netEvent, client->ip, client->port);
+            return;
+        }
+    }
+    // Let everyone else who can see the attacker know
+    for(const auto& c : sg.clients)
+    {
+        if(c.charId == e.charId || !sg.interest.isInterested(c.charId, e.charId)) continue;
+        send(netEvent, c.ip, c.port);
+    }
+    sendSubscribers(sg, netEvent);
+}
+
+///////////////////////////////////////////////////
+// SPECTATE
+///////////////////////////////////////////////////
+void GameWorker::handleSpectate(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.spectate;
+    // Subscribers are sent everything, so only take them from relays
+    // we know about, and send to wherever the request actually came
+    // from rather than wherever it says
+    const auto& relays = mSettings->relays;
+    if(std::find(relays.begin(), relays.end(), netEvent.sender) == relays.end())
+    {
+        servlog(Warn, "spectate") << netEvent.sender.toString()
+            << " is not a relay, ignoring" << std::endl;
+        return;
+    }
+    // Nothing to watch yet. The relay will ask again
+    if(mGames.count(e.gameId) == 0) return;
+    ServerGame& sg = mGames[e.gameId];
+    auto it = std::find_if(sg.subscribers.begin(), sg.subscribers.end(),
+        [&netEvent](const ServerGame::Subscriber& s)
+        {
+            return s.ip == netEvent.sender && s.port == netEvent.senderPort;
+        });
+    if(e.leave)
+    {
+        if(it != sg.subscribers.end()) sg.subscribers.erase(it);
+        return;
+    }
+    // Relays subscribe again every so often, which keeps them here
+    float expires = sg.game.time + mSettings->clientTimeout;
+    if(it != sg.subscribers.end())
+    {
+        it->expires = expires;
+        return;
+    }
+    if(sg.subscribers.size() >= mSettings->maxSubscribers)
+    {
+        servlog(Warn, "spectate") << "Game " << e.gameId
+            << " already has " << sg.subscribers.size() << " relays" << std::endl;
+        return;
+    }
+    servout << netEvent.sender.toString() << ":" << netEvent.senderPort
+        << " is relaying game " << e.gameId << std::endl;
+    sg.subscribers.push_back((ServerGame::Subscriber){
+        .ip = netEvent.sender,
+        .port = netEvent.senderPort,
+        .expires = expires
+    });
+}
+
+void GameWorker::tick(ServerGame& sg, float dt)
+{
+    // Process parts of the game which result in events being sent
+    for(auto attack : sg.game.targetAttacks)
+    {
+        if(attack->update(dt))
+        {
+            // Attack has triggered, so tell the clients about it
+            NetworkManager::Event netEvent = attack->getEvent();
+            for(const auto& c : sg.clients)
+            {
+                if(netEvent.type == NetworkManager::Event::Damage &&
+                    !sg.interest.isInterested(c.charId, netEvent.damage.charId)) continue;
+                send(netEvent, c.ip, c.port);
+            }
+        }
+    }
+    // Process the gameplay
+    sg.game.update(dt);
+    sg.game.store.record(sg.game.time);
+    sg.interest.update(sg.game);
+
+    sg.snapshotTimer += dt;
+    if(mSettings->snapshotRate > 0.0f && sg.snapshotTimer >= 1.0f / mSettings->snapshotRate)
+    {
+        sg.snapshotTimer -= 1.0f / mSettings->snapshotRate;
+        sendSnapshots(sg);
+    }
+}
+
+// Send a snapshot of the game to each client, delta compressed against
+// the last snapshot they acknowledged
+void GameWorker::sendSnapshots(ServerGame& sg)
+{
+    Snapshot snapshot(sg.game, ++sg.snapshotSequence);
+    NetworkManager::Event netEvent;
+    netEvent.type = NetworkManager::Event::Snapshot;
+    netEvent.snapshot = {
+        .gameId = sg.game.gameId
+    };
+    for(auto& c : sg.clients)
+    {
+        // If the acked snapshot has fallen out of the history then
+        // this sends everything
+        const Snapshot* baseline = c.snapshots.get(c.snapshotAck);
+        // Only include characters this client can see. Those it can't
+        // keep whatever it last knew, so they aren't sent as removed
+        Snapshot visible = snapshot;
+        for(auto it = visible.characters.begin(); it != visible.characters.end();)
+        {
+            if(sg.interest.isInterested(c.charId, it->first))
+            {
+                ++it;
+            }
+            else if(baseline != nullptr && baseline->characters.count(it->first) > 0)
+            {
+                it->second = baseline->characters.at(it->first);
+                ++it;
+            }
+            else
+            {
+                it = visible.characters.erase(it);
+            }
+        }
+        Snapshot delta = visible.diff(baseline);
+        if(mSettings->bandwidth > 0.0f) prioritise(sg, c, delta);
+        netEvent.delta = std::make_shared<Snapshot>(delta);
+        send(netEvent, c.ip, c.port);
+        // Remember what the client will know once it has this,
+        // including characters it can no longer see. Anything left out
+        // for lack of room still differs from this, so is tried again
+        c.snapshots.store(baseline == nullptr ? delta : delta.merge(*baseline));
+    }
+
+    // Relays see everything, and do the delta compression for their
+    // own spectators
+    sg.subscribers.erase(std::remove_if(sg.subscribers.begin(), sg.subscribers.end(),
+        [&sg](const ServerGame::Subscriber& s) { return s.expires < sg.game.time; }),
+        sg.subscribers.end());
+    if(sg.subscribers.empty()) return;
+    netEvent.delta = std::make_shared<Snapshot>(snapshot);
+    sendSubscribers(sg, netEvent);
+}
+
+void GameWorker::sendSubscribers(ServerGame& sg, const NetworkManager::Event& event)
+{
+    for(const auto& s : sg.subscribers) send(event, s.ip, s.port);
+}
+
+void GameWorker::prioritise(ServerGame& sg, ServerGame::Client& client, Snapshot& delta)
+{
+    sf::Vector2f centre;
+    if(sg.game.characters.count(client.charId) > 0)
+    {
+        centre = sg.game.getPos(client.charId);
+    }
+
+    std::vector<PriorityAccumulator::Candidate> candidates;
+    for(const auto& ch : delta.characters)
+    {
+        const Snapshot::CharState& s = ch.second;
+        // Removed characters are no longer anywhere, but the client
+        // should find out they've gone as soon as any nearby change
+        const sf::Vector2f& pos = s.fields & Snapshot::Field::Removed ?
+            centre : sg.game.getPos(ch.first);
+        float weight = std::pow(0.5f, vecmath::norm(pos - centre) / mSettings->priorityDistanceScale);
+        // Health changing matters more than someone walking about, and
+        // so does a character the client has never seen or has lost
+        if(s.fields & (Snapshot::Field::Hp | Snapshot::Field::Mp | Snapshot::Field::Team | Snapshot::Field::Removed))
+        {
+            weight *= mSettings->priorityHpWeight;
+        }
+        candidates.push_back((PriorityAccumulator::Candidate){
+            ch.first, weight, Snapshot::size(s)
+        });
+    }
+
+    // Every snapshot costs its header whatever is in it
+    float interval = 1.0f / mSettings->snapshotRate;
+    float budget = std::max(0.0f,
+        mSettings->bandwidth - Snapshot::headerSize * mSettings->snapshotRate);
+    std::vector<sf::Uint8> selected = client.priority.select(candidates,
+        interval, budget, budget * mSettings->bandwidthBurst);
+
+    std::map<sf::Uint8, Snapshot::CharState> characters;
+    for(auto charId : selected) characters[charId] = delta.characters[charId];
+    delta.characters.swap(characters);
+}
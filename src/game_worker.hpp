@@ -0,0 +1,202 @@
+#ifndef GAME_WORKER_HPP
+#define GAME_WORKER_HPP
+
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "game_container.hpp"
+#include "network_manager.hpp"
+#include "entity_manager.hpp"
+#include "interest_grid.hpp"
+#include "snapshot.hpp"
+#include "server_settings.hpp"
+#include "priority_accumulator.hpp"
+
+// A game being run by the server, along with the server-only state
+// of the clients playing it
+class ServerGame
+{
+public:
+    struct Client
+    {
+        sf::Uint8 charId;
+        sf::IpAddress ip;
+        sf::Uint16 port;
+        // Snapshots sent to this client, and the newest one
+        // it has acknowledged
+        SnapshotHistory snapshots;
+        sf::Uint32 snapshotAck;
+        // Which characters to send when they don't all fit
+        PriorityAccumulator priority;
+        // The last position the client gave that was accepted, and the
+        // game time then. It can't have got further than its speed
+        // allows since
+        sf::Vector2f movedFrom;
+        float movedAt;
+    };
+
+    // Relay watching the game on behalf of its spectators. Relays get
+    // every snapshot whole, so nothing depends on them acking
+    struct Subscriber
+    {
+        sf::IpAddress ip;
+        sf::Uint16 port;
+        // Game time they're dropped at unless they subscribe again
+        float expires;
+    };
+
+    GameContainer game;
+    // Dense list of the players in the game, so broadcasting only
+    // walks clients that are actually here
+    std::vector<Client> clients;
+    // Which characters each player can see, used to filter what
+    // gets sent to them
+    InterestGrid interest;
+    std::vector<Subscriber> subscribers;
+
+    float snapshotTimer;
+    sf::Uint32 snapshotSequence;
+
+private:
+    // Position of each charId in clients, or -1
+    std::vector<int> mClientIndex;
+
+public:
+    ServerGame() : snapshotTimer(0.0f), snapshotSequence(0), mClientIndex(256, -1) {}
+
+    Client* getClient(sf::Uint8 charId)
+    {
+        int i = mClientIndex[charId];
+        return i < 0 ? nullptr : &clients[i];
+    }
+
+    Client& addClient(sf::Uint8 charId)
+    {
+        if(mClientIndex[charId] < 0)
+        {
+            mClientIndex[charId] = clients.size();
+            clients.push_back(Client());
+        }
+        Client& client = clients[mClientIndex[charId]];
+        client.charId = charId;
+        return client;
+    }
+
+    void removeClient(sf::Uint8 charId)
+    {
+        int i = mClientIndex[charId];
+        if(i < 0) return;
+        // Swap the last client into this one's place
+        clients[i] = clients.back();
+        mClientIndex[clients[i].charId] = i;
+        clients.pop_back();
+        mClientIndex[charId] = -1;
+    }
+};
+
+// Owns a share of the server's games and runs them on its own thread.
+// The server routes each event to the worker owning its game, then
+// asks every worker to run the same number of ticks in parallel. Once
+// they are all finished the server sends everything they queued up,
+// so packets from every game go out together once per tick
+class GameWorker
+{
+public:
+
+    // Packet the worker wants sending
+    struct Outgoing
+    {
+        NetworkManager::Event event;
+        sf::IpAddress ip;
+        sf::Uint16 port;
+    };
+
+    // Outcome of a Connect, so the server can keep track of who is
+    // connected to what
+    struct Joined
+    {
+        sf::IpAddress ip;
+        sf::Uint16 port;
+        sf::Uint16 gameId;
+        sf::Uint8 charId;
+        bool accepted;
+    };
+
+private:
+
+    // Only used to look up round trip times, which is thread safe
+    NetworkManager* mNmgr;
+    EntityManager* mMgr;
+    const ServerSettings* mSettings;
+    std::map<sf::Uint16, ServerGame> mGames;
+
+    std::vector<NetworkManager::Event> mInbox;
+    // Where each character's newest Move is in mInbox, by clientKey
+    std::map<sf::Uint32, size_t> mMoves;
+    sf::Uint64 mCoalesced;
+    std::vector<Outgoing> mOutbox;
+    std::vector<Joined> mJoined;
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    bool mStarted;
+    bool mKill;
+    unsigned int mTicks;
+    float mDt;
+
+    void loop();
+
+    void handle(NetworkManager::Event& netEvent);
+    void handleConnect(NetworkManager::Event& netEvent);
+    void handleDisconnect(NetworkManager::Event& netEvent);
+    void handleMove(NetworkManager::Event& netEvent);
+    void handleSnapshotAck(NetworkManager::Event& netEvent);
+    void handleAutoAttack(NetworkManager::Event& netEvent);
+    void handleSpectate(NetworkManager::Event& netEvent);
+
+    void tick(ServerGame& sg, float dt);
+    void sendSnapshots(ServerGame& sg);
+    // Send to every relay watching the game
+    void sendSubscribers(ServerGame& sg, const NetworkManager::Event& event);
+    // Cut a client's snapshot down to the characters most worth
+    // sending that fit in their bandwidth
+    void prioritise(ServerGame& sg, ServerGame::Client& client, Snapshot& delta);
+
+    void send(const NetworkManager::Event& event, const sf::IpAddress& ip, sf::Uint16 port)
+    {
+        mOutbox.push_back((Outgoing){ .event = event, .ip = ip, .port = port });
+    }
+
+public:
+
+    GameWorker(NetworkManager* nmgr, EntityManager* mgr, const ServerSettings* settings);
+    ~GameWorker();
+
+    // Queue an event for one of this worker's games. A Move replaces
+    // any older Move for the same character queued since the last
+    // start. Must only be called while the worker is not running
+    void push(const NetworkManager::Event& event);
+
+    // Handle the queued events then run the given number of ticks
+    void start(unsigned int ticks, float dt);
+    // Block until the ticks have finished
+    void finish();
+
+    // Everything produced since these were last cleared. Must only be
+    // accessed while the worker is not running
+    std::vector<Outgoing>& outbox() { return mOutbox; }
+    std::vector<Joined>& joined() { return mJoined; }
+
+    // Moves replaced by a newer one before they were handled
+    sf::Uint64 coalesced() const { return mCoalesced; }
+    // Games this worker is running. Only valid while it isn't
+    size_t games() const { return mGames.size(); }
+};
+
+#endif /* GAME_WORKER_HPP */
@@ -0,0 +1,72 @@
+#include <map>
+#include <set>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <SFML/System.hpp>
+
+#include "interest_grid.hpp"
+#include "game_container.hpp"
+#include "game_map.hpp"
+
+InterestGrid::InterestGrid(const GameMap* map, const sf::Vector2f& radius,
+    float hysteresis, unsigned int cellSize) :
+    mCellSize(cellSize),
+    mRadius(radius),
+    mHysteresis(hysteresis)
+{
+    mW = map->tilemap.w / mCellSize + 1;
+    mH = map->tilemap.h / mCellSize + 1;
+    mCells.resize(mW * mH);
+}
+
+void InterestGrid::update(const GameContainer& game)
+{
+    if(mCells.empty()) return;
+    // Bucket the characters by position
+    for(auto& cell : mCells) cell.clear();
+    for(const auto& ch : game.characters)
+    {
+        const sf::Vector2f& p = game.getPos(ch.first);
+        unsigned int x = std::min<unsigned int>(std::max(0.0f, p.x) / mCellSize, mW-1);
+        unsigned int y = std::min<unsigned int>(std::max(0.0f, p.y) / mCellSize, mH-1);
+        mCells[cellIndex(x, y)].push_back(ch.first);
+    }
+
+    std::map<sf::Uint8, std::set<sf::Uint8>> interests;
+    const sf::Vector2f outer = mRadius + sf::Vector2f(mHysteresis, mHysteresis);
+    for(const auto& player : game.characters)
+    {
+        if(!player.second.isPlayer) continue;
+        const sf::Vector2f& p = game.getPos(player.first);
+        const std::set<sf::Uint8>& old = mInterests[player.first];
+        std::set<sf::Uint8>& now = interests[player.first];
+
+        // Only the cells overlapping the outer edge can contain anything
+        int x0 = std::max(0, (int)std::floor((p.x - outer.x) / mCellSize));
+        int y0 = std::max(0, (int)std::floor((p.y - outer.y) / mCellSize));
+        int x1 = std::min((int)mW-1, (int)std::floor((p.x + outer.x) / mCellSize));
+        int y1 = std::min((int)mH-1, (int)std::floor((p.y + outer.y) / mCellSize));
+        for(int y = y0; y <= y1; ++y)
+        {
+            for(int x = x0; x <= x1; ++x)
+            {
+                for(auto charId : mCells[cellIndex(x, y)])
+                {
+                    const sf::Vector2f d = game.getPos(charId) - p;
+                    bool inner = std::abs(d.x) <= mRadius.x && std::abs(d.y) <= mRadius.y;
+                    bool inOuter = std::abs(d.x) <= outer.x && std::abs(d.y) <= outer.y;
+                    if(inner || (inOuter && old.count(charId) > 0)) now.insert(charId);
+                }
+            }
+        }
+    }
+    mInterests.swap(interests);
+}
+
+bool InterestGrid::isInterested(sf::Uint8 player, sf::Uint8 charId) const
+{
+    if(player == charId) return true;
+    auto it = mInterests.find(player);
+    return it != mInterests.end() && it->second.count(charId) > 0;
+}
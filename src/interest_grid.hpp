@@ -0,0 +1,54 @@
+#ifndef INTEREST_GRID_HPP
+#define INTEREST_GRID_HPP
+
+#include <map>
+#include <set>
+#include <vector>
+#include <SFML/System.hpp>
+
+#include "game_container.hpp"
+
+// Works out which characters each player in a game needs to be told
+// about. Characters are bucketed into a coarse grid over the map so
+// finding everything near a player only has to look at nearby cells,
+// instead of at every character in the game.
+// A character becomes interesting once it is within radius of the
+// player's character (roughly what fits on their screen), and stays
+// interesting until it is further than radius + hysteresis away, so
+// characters on the edge don't flicker in and out
+class InterestGrid
+{
+private:
+    unsigned int mCellSize;
+    unsigned int mW;
+    unsigned int mH;
+    std::vector<std::vector<sf::Uint8>> mCells;
+
+    sf::Vector2f mRadius;
+    float mHysteresis;
+
+    // Characters each player is currently interested in
+    std::map<sf::Uint8, std::set<sf::Uint8>> mInterests;
+
+    unsigned int cellIndex(unsigned int x, unsigned int y) const
+    {
+        return y * mW + x;
+    }
+
+public:
+
+    InterestGrid() : mCellSize(1), mW(0), mH(0), mHysteresis(0.0f) {}
+    // radius gives the half-width and half-height of the area around
+    // each player, in tiles
+    InterestGrid(const GameMap* map, const sf::Vector2f& radius,
+        float hysteresis, unsigned int cellSize);
+
+    // Rebucket every character and recalculate the interests of every
+    // character in the game with isPlayer set
+    void update(const GameContainer& game);
+
+    // Players are always interested in themselves
+    bool isInterested(sf::Uint8 player, sf::Uint8 charId) const;
+};
+
+#endif /* INTEREST_GRID_HPP */
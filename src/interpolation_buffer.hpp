@@ -0,0 +1,71 @@
+#ifndef INTERPOLATION_BUFFER_HPP
+#define INTERPOLATION_BUFFER_HPP
+
+#include <SFML/System.hpp>
+#include <algorithm>
+
+// Recent positions of a character controlled by someone else, as told
+// to us by the server, along with when we were told. Rendering them a
+// little in the past and interpolating between the positions either
+// side makes them move smoothly, without having to pathfind for them
+class InterpolationBuffer
+{
+private:
+
+    struct Sample
+    {
+        float t;
+        sf::Vector2f pos;
+    };
+
+    static const unsigned int size = 16;
+    Sample mSamples[size];
+    unsigned int mCount;
+    unsigned int mNewest;
+
+    const Sample& at(unsigned int i) const
+    {
+        // 0 is the oldest sample
+        return mSamples[(mNewest + size + 1 - mCount + i) % size];
+    }
+
+public:
+
+    InterpolationBuffer() : mCount(0), mNewest(size-1) {}
+
+    // Samples must be pushed in time order
+    void push(float t, const sf::Vector2f& pos)
+    {
+        mNewest = (mNewest + 1) % size;
+        mSamples[mNewest] = (Sample){ t, pos };
+        if(mCount < size) ++mCount;
+    }
+
+    bool empty() const { return mCount == 0; }
+
+    // Position at time t. Interpolates between the samples either side,
+    // or extrapolates from the last two if t is after the newest
+    sf::Vector2f sample(float t) const
+    {
+        if(mCount == 1 || t <= at(0).t) return at(0).pos;
+        for(unsigned int i = 1; i < mCount; ++i)
+        {
+            const Sample& a = at(i-1);
+            const Sample& b = at(i);
+            if(t <= b.t)
+            {
+                float u = b.t > a.t ? (t - a.t) / (b.t - a.t) : 1.0f;
+                return a.pos + (b.pos - a.pos) * u;
+            }
+        }
+        // Never guess too far past the newest sample
+        const float maxExtrapolation = 0.25f;
+        const Sample& a = at(mCount-2);
+        const Sample& b = at(mCount-1);
+        if(b.t <= a.t) return b.pos;
+        float dt = std::min(t - b.t, maxExtrapolation);
+        return b.pos + (b.pos - a.pos) * (dt / (b.t - a.t));
+    }
+};
+
+#endif /* INTERPOLATION_BUFFER_HPP */
@@ -0,0 +1,106 @@
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "join_state.hpp"
+#include "game_container.hpp"
+#include "entity_manager.hpp"
+#include "network_manager.hpp"
+#include "lz.hpp"
+
+// Larger states than this are assumed to be malicious
+static const sf::Uint32 maxSize = 1 << 20;
+
+JoinState::JoinState(const GameContainer& game) :
+    time(game.time)
+{
+    characters.reserve(game.characters.size());
+    for(const auto& ch : game.characters)
+    {
+        const GameContainer::CharWrapper& w = ch.second;
+        size_t i = game.store.index(w.entity);
+        characters.push_back((CharState){
+            .charId = ch.first,
+            .team = w.team,
+            .isPlayer = w.isPlayer,
+            .pos = game.store.pos[i],
+            .target = w.pfHelper.target,
+            .hp = game.store.hp[i],
+            .mp = game.store.mp[i],
+            .gold = w.gold,
+            .kills = w.kills,
+            .assists = w.assists,
+            .deaths = w.deaths
+        });
+    }
+}
+
+void JoinState::apply(GameContainer& game, EntityManager* mgr) const
+{
+    for(const auto& s : characters)
+    {
+        sf::Uint8 charId = s.charId;
+        if(game.characters.count(charId) == 0 &&
+            !game.add("character_fighter", s.team, mgr, &charId))
+        {
+            continue;
+        }
+        auto& ch = game.characters[charId];
+        ch.isPlayer = s.isPlayer;
+        size_t i = game.indexOf(charId);
+        game.store.hp[i] = s.hp;
+        game.store.mp[i] = s.mp;
+        ch.gold = s.gold;
+        ch.kills = s.kills;
+        ch.assists = s.assists;
+        ch.deaths = s.deaths;
+        if(charId == game.client) continue;
+        game.setPos(charId, s.pos);
+        game.setTarget(charId, s.target);
+    }
+}
+
+void JoinState::write(sf::Packet& packet) const
+{
+    sf::Packet body;
+    body << time << static_cast<sf::Uint16>(characters.size());
+    for(const auto& s : characters)
+    {
+        body << s.charId << static_cast<sf::Uint8>(s.team) << s.isPlayer
+             << s.pos << s.target << s.hp << s.mp
+             << s.gold << s.kills << s.assists << s.deaths;
+    }
+    std::string raw(static_cast<const char*>(body.getData()), body.getDataSize());
+    packet << version << static_cast<sf::Uint32>(raw.size()) << lz::compress(raw);
+}
+
+bool JoinState::read(sf::Packet& packet)
+{
+    sf::Uint8 v = 0;
+    sf::Uint32 size = 0;
+    std::string compressed;
+    if(!(packet >> v >> size >> compressed)) return false;
+    if(v != version || size > maxSize) return false;
+    std::string raw;
+    if(!lz::decompress(compressed, size, raw)) return false;
+
+    sf::Packet body;
+    if(!raw.empty()) body.append(raw.data(), raw.size());
+    sf::Uint16 count = 0;
+    if(!(body >> time >> count)) return false;
+    characters.clear();
+    for(int i = 0; i < count; ++i)
+    {
+        CharState s = {};
+        sf::Uint8 team = 0;
+        if(!(body >> s.charId >> team >> s.isPlayer >> s.pos >> s.target
+            >> s.hp >> s.mp >> s.gold >> s.kills >> s.assists >> s.deaths))
+        {
+            return false;
+        }
+        s.team = static_cast<GameContainer::Team>(team);
+        characters.push_back(s);
+    }
+    return true;
+}
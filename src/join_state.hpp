@@ -0,0 +1,54 @@
+#ifndef JOIN_STATE_HPP
+#define JOIN_STATE_HPP
+
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "game_container.hpp"
+
+class EntityManager;
+
+// Everything a client joining a game part way through needs to know
+// about it, sent in one message instead of an event per character.
+// The body is compressed, and NetworkManager splits it across as
+// many datagrams as it takes
+class JoinState
+{
+public:
+
+    // Bumped whenever the layout changes, so old clients refuse new
+    // states instead of misreading them
+    static const sf::Uint8 version = 1;
+
+    struct CharState
+    {
+        sf::Uint8 charId;
+        GameContainer::Team team;
+        bool isPlayer;
+        sf::Vector2f pos;
+        sf::Vector2f target;
+        float hp;
+        float mp;
+        sf::Uint32 gold;
+        sf::Uint32 kills;
+        sf::Uint32 assists;
+        sf::Uint32 deaths;
+    };
+
+    float time;
+    std::vector<CharState> characters;
+
+    JoinState() : time(0.0f) {}
+    // Capture the whole game in one pass
+    explicit JoinState(const GameContainer& game);
+
+    // Add any characters the game is missing and bring the rest up to
+    // date. The client's own character keeps its predicted position
+    void apply(GameContainer& game, EntityManager* mgr) const;
+
+    void write(sf::Packet& packet) const;
+    bool read(sf::Packet& packet);
+};
+
+#endif /* JOIN_STATE_HPP */
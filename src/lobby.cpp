@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <map>
+#include <string>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#ifdef __unix__
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+#include "lobby.hpp"
+
+Lobby::Lobby(const JsonBox::Value& v, NetworkManager* nmgr, const std::string& executable) :
+    mNmgr(nmgr),
+    mExecutable(executable),
+    mShardTimeout(sf::seconds(5.0f)),
+    mRunning(true)
+{
+    JsonBox::Object o = v.getObject();
+
+    auto has = [&o](const std::string& s) { return o.find(s) != o.end(); };
+
+    unsigned int shards = 2;
+    unsigned short firstPort = 49520;
+    bool spawnShards = true;
+    if(has("shards")) shards = o["shards"].tryGetInteger(shards);
+    if(has("firstShardPort")) firstPort = o["firstShardPort"].tryGetInteger(firstPort);
+    if(has("spawn")) spawnShards = o["spawn"].tryGetBoolean(spawnShards);
+    if(has("shardTimeout")) mShardTimeout = sf::seconds(o["shardTimeout"].tryGetFloat(5.0f));
+
+    for(unsigned int i = 0; i < shards; ++i)
+    {
+        mShards.push_back((Shard){
+            .port = static_cast<unsigned short>(firstPort + i),
+            .reportedAt = sf::Time::Zero,
+            .reported = false,
+            .load = 0.0f,
+            .games = 0,
+            .players = 0,
+            .assigned = 0,
+            .pid = 0
+        });
+        if(spawnShards) spawn(mShards.back());
+    }
+    servout << "Lobby in front of " << shards << " shards from port " << firstPort << std::endl;
+}
+
+Lobby::~Lobby()
+{
+    shutdown();
+}
+
+void Lobby::run()
+{
+    while(mRunning)
+    {
+        NetworkManager::Event netEvent;
+        while(mNmgr->pollEvent(netEvent))
+        {
+            switch(netEvent.type)
+            {
+                default:
+                    break;
+                case NetworkManager::Event::Connect:
+                    handleConnect(netEvent);
+                    break;
+                case NetworkManager::Event::ShardReport:
+                    handleShardReport(netEvent);
+                    break;
+                case NetworkManager::Event::Disconnect:
+                    // Same shutdown message as the server
+                    if(netEvent.disconnect.gameId == 65535 &&
+                        netEvent.disconnect.charId == 255)
+                    {
+                        mRunning = false;
+                    }
+                    break;
+            }
+        }
+        check();
+        mNmgr->update();
+        // Nothing here is urgent enough to need a tick rate
+        sf::sleep(sf::milliseconds(10));
+    }
+}
+
+void Lobby::handleConnect(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.connect;
+    // Answer where the Connect came from. The address the client wrote
+    // is often not the one it has a connection to us on
+    const sf::IpAddress& ip = netEvent.sender;
+    sf::Uint16 port = netEvent.senderPort;
+    Shard* shard = shardFor(e.gameId);
+    NetworkManager::Event response;
+    if(shard == nullptr)
+    {
+        servout << "No shards are up, turning away " << ip.toString()
+            << ":" << port << std::endl;
+        response.type = NetworkManager::Event::GameFull;
+        response.gameFull = {
+            .gameId = e.gameId
+        };
+        mNmgr->send(response, ip, port);
+        return;
+    }
+    // Shards are on this host, so the client can reach them on the
+    // address it reached us on
+    response.type = NetworkManager::Event::Redirect;
+    response.redirect = {
+        .gameId = e.gameId,
+        .ip = sf::IpAddress(0, 0, 0, 0),
+        .port = shard->port
+    };
+    servout << "Sending " << ip.toString() << ":" << port << " to game "
+        << e.gameId << " on port " << shard->port << std::endl;
+    mNmgr->send(response, ip, port);
+}
+
+void Lobby::handleShardReport(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.shardReport;
+    // Shards run on this host and report from the port they serve on,
+    // so anything else claiming to be one isn't
+    if(netEvent.sender != sf::IpAddress::LocalHost || netEvent.senderPort != e.port)
+    {
+        servout << "Ignoring report for port " << e.port << " from "
+            << netEvent.sender.toString() << ":" << netEvent.senderPort << std::endl;
+        return;
+    }
+    for(auto& shard : mShards)
+    {
+        if(shard.port != e.port) continue;
+        if(!shard.reported) servout << "Shard on port " << e.port << " is up" << std::endl;
+        shard.reportedAt = mClock.getElapsedTime();
+        shard.reported = true;
+        shard.load = e.load;
+        shard.games = e.games;
+        shard.players = e.players;
+        shard.assigned = 0;
+        return;
+    }
+    servout << "Report from unknown shard on port " << e.port << std::endl;
+}
+
+bool Lobby::isAlive(const Shard& shard) const
+{
+    return shard.reported && mClock.getElapsedTime() - shard.reportedAt < mShardTimeout;
+}
+
+Lobby::Shard* Lobby::shardFor(sf::Uint16 gameId)
+{
+    auto it = mGames.find(gameId);
+    if(it != mGames.end() && isAlive(mShards[it->second])) return &mShards[it->second];
+
+    // Reports are a second or so old, so count the games handed out
+    // since then as a guess at the load they'll add
+    const float loadPerGame = 0.05f;
+    Shard* best = nullptr;
+    float bestLoad = 0.0f;
+    for(auto& shard : mShards)
+    {
+        if(!isAlive(shard)) continue;
+        float load = shard.load + shard.assigned * loadPerGame;
+        if(best == nullptr || load < bestLoad)
+        {
+            best = &shard;
+            bestLoad = load;
+        }
+    }
+    if(best == nullptr) return nullptr;
+    ++best->assigned;
+    mGames[gameId] = best - &mShards[0];
+    return best;
+}
+
+void Lobby::spawn(Shard& shard)
+{
+#ifdef __unix__
+    std::string port = std::to_string(shard.port);
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(mExecutable.c_str()));
+    argv.push_back(const_cast<char*>("shard"));
+    argv.push_back(const_cast<char*>(port.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid = 0;
+    if(posix_spawn(&pid, mExecutable.c_str(), nullptr, nullptr, &argv[0], environ) != 0)
+    {
+        servout << "Failed to start shard on port " << shard.port << std::endl;
+        return;
+    }
+    shard.pid = pid;
+    shard.reported = false;
+    servout << "Started shard on port " << shard.port << " as process " << pid << std::endl;
+#else
+    servout << "Can't start shards on this platform, start them by hand" << std::endl;
+#endif
+}
+
+void Lobby::check()
+{
+    for(size_t i = 0; i < mShards.size(); ++i)
+    {
+        Shard& shard = mShards[i];
+#ifdef __unix__
+        int status = 0;
+        if(shard.pid != 0 && waitpid(shard.pid, &status, WNOHANG) == shard.pid)
+        {
+            servout << "Shard on port " << shard.port << " exited, restarting it" << std::endl;
+            shard.pid = 0;
+            spawn(shard);
+        }
+#endif
+        if(isAlive(shard)) continue;
+        // Its games are lost, or at least unreachable, so let them
+        // start again somewhere else
+        for(auto it = mGames.begin(); it != mGames.end();)
+        {
+            if(it->second == i) it = mGames.erase(it);
+            else ++it;
+        }
+    }
+}
+
+void Lobby::shutdown()
+{
+    NetworkManager::Event netEvent;
+    netEvent.type = NetworkManager::Event::Disconnect;
+    netEvent.disconnect = {
+        .ip = sf::IpAddress::LocalHost,
+        .port = mNmgr->getPort(),
+        .gameId = 65535,
+        .charId = 255
+    };
+    for(const auto& shard : mShards)
+    {
+        mNmgr->send(netEvent, sf::IpAddress::LocalHost, shard.port);
+    }
+#ifdef __unix__
+    // Give them a moment, resending in case it went missing, then
+    // stop waiting politely, then stop asking
+    sf::Clock clock;
+    int signalled = 0;
+    while(true)
+    {
+        bool waiting = false;
+        for(auto& shard : mShards)
+        {
+            if(shard.pid == 0) continue;
+            pid_t pid = waitpid(shard.pid, nullptr, WNOHANG);
+            // Anything but an interruption means there's nothing left
+            // to wait for, such as ECHILD if it was already reaped
+            if(pid == shard.pid || (pid == -1 && errno != EINTR)) shard.pid = 0;
+            else waiting = true;
+        }
+        if(!waiting) break;
+
+        int next = clock.getElapsedTime() > sf::seconds(4.0f) ? SIGKILL :
+            clock.getElapsedTime() > sf::seconds(2.0f) ? SIGTERM : 0;
+        if(next != signalled)
+        {
+            signalled = next;
+            for(const auto& shard : mShards)
+            {
+                if(shard.pid != 0) kill(shard.pid, signalled);
+            }
+        }
+        mNmgr->update();
+        sf::sleep(sf::milliseconds(10));
+    }
+#endif
+}
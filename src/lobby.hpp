@@ -0,0 +1,77 @@
+#ifndef LOBBY_HPP
+#define LOBBY_HPP
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+
+#include "network_manager.hpp"
+
+// Front door for a server split across several processes on the same
+// host. Clients connect to the lobby as if it were the server, and are
+// redirected to whichever shard runs their game. Each shard is an
+// ordinary server which reports how busy it is every so often, and new
+// games go to the least busy shard. The lobby can start the shards
+// itself, and restarts any which die, so one crashing game only takes
+// its own shard down
+class Lobby
+{
+private:
+
+    struct Shard
+    {
+        unsigned short port;
+        // When we last heard from it, and what it said
+        sf::Time reportedAt;
+        bool reported;
+        float load;
+        sf::Uint16 games;
+        sf::Uint16 players;
+        // Games sent its way since it last reported, which its load
+        // doesn't include yet
+        unsigned int assigned;
+        // Process id, if we started it
+        int pid;
+    };
+
+    NetworkManager* mNmgr;
+    std::string mExecutable;
+    std::vector<Shard> mShards;
+    // Which shard each game is running on
+    std::map<sf::Uint16, size_t> mGames;
+    sf::Time mShardTimeout;
+    sf::Clock mClock;
+    std::atomic<bool> mRunning;
+
+    void handleConnect(NetworkManager::Event& netEvent);
+    void handleShardReport(NetworkManager::Event& netEvent);
+
+    bool isAlive(const Shard& shard) const;
+    // Shard the game is on, giving it to the least busy one if it
+    // isn't on any yet. Returns nullptr if no shards are up
+    Shard* shardFor(sf::Uint16 gameId);
+    // Start a shard process, on platforms which can
+    void spawn(Shard& shard);
+    // Restart shards which have died, and move games off shards which
+    // have stopped reporting
+    void check();
+    // Ask every shard to stop, and wait for the ones we started
+    void shutdown();
+
+public:
+
+    // Read the lobby block of the config. If spawn is set, shards are
+    // started by running executable with "shard" and their port
+    Lobby(const JsonBox::Value& v, NetworkManager* nmgr, const std::string& executable);
+    ~Lobby();
+
+    // Run until a client sends the shutdown message, or stop is called
+    void run();
+    // Safe to call from any thread
+    void stop() { mRunning = false; }
+};
+
+#endif /* LOBBY_HPP */
@@ -0,0 +1,317 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+
+#include "logger.hpp"
+
+Logger::Logger() :
+    mCells(capacity),
+    mHead(0),
+    mTail(0),
+    mLevel(Info),
+    mRateLimit(100),
+    mDropped(0),
+    mOut(stdout),
+    mNext(nullptr),
+    mStart(std::chrono::steady_clock::now()),
+    mRunning(true)
+{
+    for(size_t i = 0; i < capacity; ++i)
+    {
+        mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    for(auto& c : mCategories)
+    {
+        c.name = nullptr;
+        c.second = -1;
+        c.count = 0;
+        c.suppressed = 0;
+    }
+    mWriter = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger()
+{
+    mRunning = false;
+    mWake.notify_one();
+    mWriter.join();
+    if(mOut != stdout) std::fclose(mOut);
+    FILE* next = mNext.exchange(nullptr);
+    if(next != nullptr) std::fclose(next);
+}
+
+Logger& Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+void Logger::load(const JsonBox::Value& v)
+{
+    JsonBox::Object o = v.getObject();
+
+    auto has = [&o](const std::string& s) { return o.find(s) != o.end(); };
+
+    if(has("level"))
+    {
+        const std::string& level = o["level"].getString();
+        if(level == "debug") mLevel = Debug;
+        else if(level == "info") mLevel = Info;
+        else if(level == "warn") mLevel = Warn;
+        else if(level == "error") mLevel = Error;
+    }
+    if(has("rateLimit")) mRateLimit = o["rateLimit"].tryGetInteger(mRateLimit);
+    if(has("file"))
+    {
+        // The writer is already running, so hand it the file rather
+        // than changing mOut under it
+        FILE* f = std::fopen(o["file"].getString().c_str(), "a");
+        if(f != nullptr)
+        {
+            FILE* old = mNext.exchange(f);
+            if(old != nullptr) std::fclose(old);
+        }
+    }
+}
+
+Logger::Category* Logger::category(const char* name)
+{
+    // Call sites pass string literals, so the same pointer usually
+    // means the same category. Fall back to comparing the text, since
+    // identical literals in different files needn't be merged
+    for(auto& c : mCategories)
+    {
+        const char* n = c.name.load(std::memory_order_acquire);
+        if(n == nullptr)
+        {
+            const char* expected = nullptr;
+            if(c.name.compare_exchange_strong(expected, name)) return &c;
+            n = expected;
+        }
+        if(n == name || std::strcmp(n, name) == 0) return &c;
+    }
+    return nullptr;
+}
+
+bool Logger::accept(Level level, const char* name)
+{
+    if(level < mLevel.load(std::memory_order_relaxed)) return false;
+    unsigned int limit = mRateLimit.load(std::memory_order_relaxed);
+    if(limit == 0) return true;
+
+    Category* c = category(name);
+    if(c == nullptr) return true;
+    sf::Int64 second = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    // Racing threads may both reset the count, which only lets a few
+    // extra lines through
+    if(c->second.exchange(second, std::memory_order_relaxed) != second)
+    {
+        c->count.store(0, std::memory_order_relaxed);
+    }
+    if(c->count.fetch_add(1, std::memory_order_relaxed) < limit) return true;
+    c->suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool Logger::push(const Record& record)
+{
+    size_t pos = mHead.load(std::memory_order_relaxed);
+    for(;;)
+    {
+        Cell& cell = mCells[pos % capacity];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if(diff == 0)
+        {
+            if(mHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.record = record;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if(diff < 0)
+        {
+            // Full
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = mHead.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Logger::pop(Record& record)
+{
+    Cell& cell = mCells[mTail % capacity];
+    size_t seq = cell.sequence.load(std::memory_order_acquire);
+    if(seq != mTail + 1) return false;
+    record = cell.record;
+    cell.sequence.store(mTail + capacity, std::memory_order_release);
+    ++mTail;
+    return true;
+}
+
+void Logger::write(const Record& record)
+{
+    static const char* const levelNames[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+    char stamp[32];
+    std::snprintf(stamp, sizeof(stamp), "%10.3f %-5s ",
+        std::chrono::duration<double>(record.time - mStart).count(),
+        levelNames[record.level]);
+    std::ostringstream out;
+    out << stamp << record.prefix;
+    const char* p = record.data;
+    const char* end = record.data + record.length;
+    while(p < end)
+    {
+        char tag = *p++;
+        switch(tag)
+        {
+            case 'i': { sf::Int64 x; std::memcpy(&x, p, sizeof(x)); p += sizeof(x); out << x; break; }
+            case 'u': { sf::Uint64 x; std::memcpy(&x, p, sizeof(x)); p += sizeof(x); out << x; break; }
+            case 'd': { double x; std::memcpy(&x, p, sizeof(x)); p += sizeof(x); out << x; break; }
+            case 'b': { out << (*p++ ? "1" : "0"); break; }
+            case 'c': { out << *p++; break; }
+            case 's':
+            {
+                sf::Uint16 n;
+                std::memcpy(&n, p, sizeof(n));
+                p += sizeof(n);
+                out.write(p, n);
+                p += n;
+                break;
+            }
+            default: p = end; break;
+        }
+    }
+    out << "\n";
+    const std::string& s = out.str();
+    std::fwrite(s.data(), 1, s.size(), mOut);
+}
+
+void Logger::run()
+{
+    Record record;
+    auto lastReport = std::chrono::steady_clock::now();
+    while(true)
+    {
+        // Switch files between lines, never part way through one
+        FILE* next = mNext.exchange(nullptr);
+        if(next != nullptr)
+        {
+            std::fflush(mOut);
+            if(mOut != stdout) std::fclose(mOut);
+            mOut = next;
+        }
+
+        bool wrote = false;
+        while(pop(record))
+        {
+            write(record);
+            wrote = true;
+        }
+        if(wrote) std::fflush(mOut);
+
+        // Say how much was thrown away, once a second at most
+        auto now = std::chrono::steady_clock::now();
+        if(now - lastReport >= std::chrono::seconds(1))
+        {
+            lastReport = now;
+            for(auto& c : mCategories)
+            {
+                const char* name = c.name.load(std::memory_order_acquire);
+                if(name == nullptr) break;
+                sf::Uint64 n = c.suppressed.exchange(0);
+                if(n > 0) std::fprintf(mOut, "[LOG] Suppressed %llu lines of %s\n",
+                    static_cast<unsigned long long>(n), name);
+            }
+            std::fflush(mOut);
+        }
+
+        if(!mRunning)
+        {
+            // Anything pushed since the last pass
+            while(pop(record)) write(record);
+            std::fflush(mOut);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mWake.wait_for(lock, std::chrono::milliseconds(5));
+    }
+}
+
+LogLine::LogLine(Logger::Level level, const char* prefix, const char* category) :
+    mEnabled(Logger::instance().accept(level, category))
+{
+    if(!mEnabled) return;
+    mRecord.time = std::chrono::steady_clock::now();
+    mRecord.prefix = prefix;
+    mRecord.category = category;
+    mRecord.level = level;
+    mRecord.length = 0;
+}
+
+LogLine::~LogLine()
+{
+    if(mEnabled) Logger::instance().push(mRecord);
+}
+
+void LogLine::put(char tag, const void* data, size_t size)
+{
+    // Whatever doesn't fit is cut off
+    if(!mEnabled || mRecord.length + 1 + size > sizeof(mRecord.data)) return;
+    mRecord.data[mRecord.length++] = tag;
+    std::memcpy(mRecord.data + mRecord.length, data, size);
+    mRecord.length += size;
+}
+
+LogLine& LogLine::operator<<(const char* s)
+{
+    if(!mEnabled) return *this;
+    // Strings are cut short to fit, rather than dropped
+    size_t room = sizeof(mRecord.data) - mRecord.length;
+    if(room <= 1 + sizeof(sf::Uint16)) return *this;
+    sf::Uint16 n = std::min(std::strlen(s), room - 1 - sizeof(sf::Uint16));
+    mRecord.data[mRecord.length++] = 's';
+    std::memcpy(mRecord.data + mRecord.length, &n, sizeof(n));
+    mRecord.length += sizeof(n);
+    std::memcpy(mRecord.data + mRecord.length, s, n);
+    mRecord.length += n;
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const std::string& s)
+{
+    return *this << s.c_str();
+}
+
+LogLine& LogLine::operator<<(char c)
+{
+    put('c', &c, 1);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(bool b)
+{
+    char x = b ? 1 : 0;
+    put('b', &x, 1);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(double d)
+{
+    put('d', &d, sizeof(d));
+    return *this;
+}
@@ -0,0 +1,175 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+
+// Logging which is cheap enough for the tick thread. Each line is
+// packed into a fixed size binary record as it's streamed, with the
+// arguments stored raw rather than formatted, and pushed onto a lock
+// free ring. A background thread formats and writes them. If the ring
+// is full the line is dropped rather than making the caller wait.
+// Lines below the minimum level cost a branch, and each category is
+// limited to a number of lines per second so a hot path can't flood
+// the log. Lines are written with the seconds since the logger
+// started and their level in front
+class Logger
+{
+public:
+
+    enum Level
+    {
+        Debug,
+        Info,
+        Warn,
+        Error
+    };
+
+    struct Record
+    {
+        std::chrono::steady_clock::time_point time;
+        const char* prefix; // String literals, so safe to keep
+        const char* category;
+        Level level;
+        sf::Uint16 length;
+        // Tagged arguments, see LogLine
+        char data[224];
+    };
+
+private:
+
+    // Bounded multi producer ring, after Dmitry Vyukov's. Each cell's
+    // sequence says whether it's free for the producer at that
+    // position or full for the consumer
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    static const size_t capacity = 4096;
+    std::vector<Cell> mCells;
+    std::atomic<size_t> mHead;
+    size_t mTail;
+
+    struct Category
+    {
+        std::atomic<const char*> name;
+        std::atomic<sf::Int64> second;
+        std::atomic<unsigned int> count;
+        std::atomic<sf::Uint64> suppressed;
+    };
+    static const unsigned int maxCategories = 64;
+    Category mCategories[maxCategories];
+
+    std::atomic<int> mLevel;
+    std::atomic<unsigned int> mRateLimit;
+    std::atomic<sf::Uint64> mDropped;
+
+    // Only the writer thread uses mOut. A file given to load waits in
+    // mNext until the writer picks it up between lines
+    FILE* mOut;
+    std::atomic<FILE*> mNext;
+    std::chrono::steady_clock::time_point mStart;
+    std::atomic<bool> mRunning;
+    std::mutex mWakeMutex;
+    std::condition_variable mWake;
+    std::thread mWriter;
+
+    Logger();
+    ~Logger();
+
+    Category* category(const char* name);
+    bool pop(Record& record);
+    void write(const Record& record);
+    void run();
+
+public:
+
+    static Logger& instance();
+
+    // Reads level (debug, info, warn or error), rateLimit (lines per
+    // second per category, 0 for no limit) and file (to log to instead
+    // of stdout)
+    void load(const JsonBox::Value& v);
+
+    void setLevel(Level level) { mLevel = level; }
+    void setRateLimit(unsigned int linesPerSecond) { mRateLimit = linesPerSecond; }
+
+    // Whether a line should be recorded, counting it against its
+    // category's limit if so
+    bool accept(Level level, const char* category);
+    // Queue a finished line. Returns false if the ring was full
+    bool push(const Record& record);
+
+    // Lines lost to a full ring
+    sf::Uint64 dropped() const { return mDropped; }
+};
+
+// One line of log, streamed into like std::cout. The line is queued
+// when the LogLine is destroyed at the end of the statement, so use
+// it as a temporary. std::endl is accepted and ignored, every line
+// gets its own newline
+class LogLine
+{
+private:
+
+    Logger::Record mRecord;
+    bool mEnabled;
+
+    void put(char tag, const void* data, size_t size);
+
+public:
+
+    LogLine(Logger::Level level, const char* prefix, const char* category);
+    ~LogLine();
+
+    LogLine& operator<<(const char* s);
+    LogLine& operator<<(const std::string& s);
+    LogLine& operator<<(char c);
+    LogLine& operator<<(signed char c) { return *this << static_cast<char>(c); }
+    LogLine& operator<<(unsigned char c) { return *this << static_cast<char>(c); }
+    LogLine& operator<<(bool b);
+    LogLine& operator<<(double d);
+    LogLine& operator<<(float f) { return *this << static_cast<double>(f); }
+    LogLine& operator<<(std::ostream& (*)(std::ostream&)) { return *this; }
+
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, LogLine&>::type
+    operator<<(T v)
+    {
+        sf::Int64 x = v;
+        put('i', &x, sizeof(x));
+        return *this;
+    }
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, LogLine&>::type
+    operator<<(T v)
+    {
+        sf::Uint64 x = v;
+        put('u', &x, sizeof(x));
+        return *this;
+    }
+    template<typename T>
+    typename std::enable_if<std::is_enum<T>::value, LogLine&>::type
+    operator<<(T v)
+    {
+        return *this << static_cast<typename std::underlying_type<T>::type>(v);
+    }
+};
+
+#define servlog(level, category) (LogLine(Logger::level, "[SERVER] ", category))
+#define clntlog(level, category) (LogLine(Logger::level, "[CLIENT] ", category))
+#define servout servlog(Info, "general")
+#define clntout clntlog(Info, "general")
+
+#endif /* LOGGER_HPP */
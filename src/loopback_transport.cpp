@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "loopback_transport.hpp"
+
+LoopbackNetwork::LoopbackNetwork(const Settings& settings) :
+    mSettings(settings),
+    mNextPort(49152),
+    mOrder(0),
+    mSent(0),
+    mDropped(0)
+{
+}
+
+std::unique_ptr<LoopbackTransport> LoopbackNetwork::open(unsigned short port)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(port == 0)
+    {
+        // Hand out ephemeral ports like a real socket would
+        while(mEndpoints.count(mNextPort) > 0 || mNextPort == 0) ++mNextPort;
+        port = mNextPort++;
+    }
+    else if(mEndpoints.count(port) > 0)
+    {
+        throw std::runtime_error("Loopback port " + std::to_string(port)
+            + " is already open");
+    }
+    std::shared_ptr<Endpoint> endpoint(new Endpoint);
+    endpoint->closed = false;
+    endpoint->woken = false;
+    mEndpoints[port] = endpoint;
+    return std::unique_ptr<LoopbackTransport>(new LoopbackTransport(this, port));
+}
+
+void LoopbackNetwork::send(unsigned short from, unsigned short to,
+    const sf::Packet& packet)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mSent;
+
+    auto link = mLinks.find(std::make_pair(from, to));
+    if(link == mLinks.end())
+    {
+        std::seed_seq seed{ mSettings.seed, unsigned(from), unsigned(to) };
+        link = mLinks.insert(std::make_pair(std::make_pair(from, to), std::mt19937(seed))).first;
+    }
+    std::mt19937& rng = link->second;
+
+    // Always roll for both, so a packet's fate doesn't depend on what
+    // happened to the ones before it
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_real_distribution<float> spread(-1.0f, 1.0f);
+    bool lost = unit(rng) < mSettings.loss;
+    float delay = std::max(0.0f, mSettings.latency + mSettings.jitter * spread(rng));
+
+    auto it = mEndpoints.find(to);
+    // Nobody listening is just another lost packet, as with UDP
+    if(lost || it == mEndpoints.end())
+    {
+        ++mDropped;
+        return;
+    }
+
+    Datagram d;
+    d.deliverAt = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(delay));
+    d.order = mOrder++;
+    d.from = from;
+    const char* data = static_cast<const char*>(packet.getData());
+    d.data.assign(data, data + packet.getDataSize());
+
+    Endpoint& endpoint = *it->second;
+    endpoint.queue.push_back(d);
+    std::push_heap(endpoint.queue.begin(), endpoint.queue.end());
+    endpoint.arrived.notify_one();
+}
+
+sf::Socket::Status LoopbackNetwork::receive(unsigned short port,
+    sf::Packet& packet, unsigned short& from)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto it = mEndpoints.find(port);
+    if(it == mEndpoints.end()) return sf::Socket::Disconnected;
+    // Keep the endpoint alive even if it's closed while we wait
+    std::shared_ptr<Endpoint> endpoint = it->second;
+
+    Clock::time_point giveUp = Clock::now() + std::chrono::milliseconds(100);
+    while(!endpoint->closed)
+    {
+        if(endpoint->woken)
+        {
+            endpoint->woken = false;
+            return sf::Socket::NotReady;
+        }
+        Clock::time_point until = giveUp;
+        if(!endpoint->queue.empty())
+        {
+            const Datagram& next = endpoint->queue.front();
+            if(next.deliverAt <= Clock::now())
+            {
+                packet.clear();
+                if(!next.data.empty()) packet.append(&next.data[0], next.data.size());
+                from = next.from;
+                std::pop_heap(endpoint->queue.begin(), endpoint->queue.end());
+                endpoint->queue.pop_back();
+                return sf::Socket::Done;
+            }
+            until = std::min(until, next.deliverAt);
+        }
+        if(endpoint->arrived.wait_until(lock, until) == std::cv_status::timeout &&
+            until == giveUp)
+        {
+            return sf::Socket::NotReady;
+        }
+    }
+    return sf::Socket::Disconnected;
+}
+
+void LoopbackNetwork::wake(unsigned short port)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mEndpoints.find(port);
+    if(it == mEndpoints.end()) return;
+    it->second->woken = true;
+    it->second->arrived.notify_all();
+}
+
+void LoopbackNetwork::close(unsigned short port)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mEndpoints.find(port);
+    if(it == mEndpoints.end()) return;
+    it->second->closed = true;
+    it->second->arrived.notify_all();
+    mEndpoints.erase(it);
+}
+
+sf::Uint64 LoopbackNetwork::sent()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSent;
+}
+
+sf::Uint64 LoopbackNetwork::dropped()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mDropped;
+}
+
+LoopbackTransport::LoopbackTransport(LoopbackNetwork* network, unsigned short port) :
+    mNetwork(network),
+    mPort(port)
+{
+}
+
+LoopbackTransport::~LoopbackTransport()
+{
+    mNetwork->close(mPort);
+}
+
+sf::Socket::Status LoopbackTransport::send(sf::Packet& packet,
+    const sf::IpAddress& remoteAddress, unsigned short remotePort)
+{
+    mNetwork->send(mPort, remotePort, packet);
+    return sf::Socket::Done;
+}
+
+sf::Socket::Status LoopbackTransport::receive(sf::Packet& packet,
+    sf::IpAddress& remoteAddress, unsigned short& remotePort)
+{
+    remoteAddress = sf::IpAddress::LocalHost;
+    return mNetwork->receive(mPort, packet, remotePort);
+}
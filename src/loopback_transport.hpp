@@ -0,0 +1,124 @@
+#ifndef LOOPBACK_TRANSPORT_HPP
+#define LOOPBACK_TRANSPORT_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "transport.hpp"
+
+class LoopbackTransport;
+
+// In-memory stand in for the network, so a server and any number of
+// clients can run in one process without touching real ports. Every
+// endpoint is on localhost and is told apart by port. Packets can be
+// delayed, jittered and dropped to imitate a real network. Each link
+// (sender and receiver port) has its own generator seeded from seed,
+// so the nth packet sent over a link is lost or delayed the same way
+// every run, however other links' traffic interleaves with it. Delays
+// are measured on the real clock though, and the threads at either end
+// aren't scheduled the same way twice, so whole runs don't repeat
+class LoopbackNetwork
+{
+public:
+
+    struct Settings
+    {
+        float latency; // One way, in seconds
+        float jitter;  // Latency varies by up to this much either way
+        float loss;    // Chance of dropping each packet, 0 to 1
+        unsigned int seed;
+    };
+
+private:
+
+    friend class LoopbackTransport;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Datagram
+    {
+        Clock::time_point deliverAt;
+        sf::Uint64 order; // Keeps packets with equal times in order
+        unsigned short from;
+        std::vector<char> data;
+
+        // Earliest first in a priority queue
+        bool operator<(const Datagram& d) const
+        {
+            if(deliverAt != d.deliverAt) return deliverAt > d.deliverAt;
+            return order > d.order;
+        }
+    };
+
+    struct Endpoint
+    {
+        std::vector<Datagram> queue; // Heap
+        std::condition_variable arrived;
+        bool closed;
+        bool woken;
+    };
+
+    Settings mSettings;
+    std::mutex mMutex;
+    std::map<unsigned short, std::shared_ptr<Endpoint>> mEndpoints;
+    unsigned short mNextPort;
+    // Generators by sender then receiver port
+    std::map<std::pair<unsigned short, unsigned short>, std::mt19937> mLinks;
+    sf::Uint64 mOrder;
+    sf::Uint64 mSent;
+    sf::Uint64 mDropped;
+
+    void send(unsigned short from, unsigned short to, const sf::Packet& packet);
+    sf::Socket::Status receive(unsigned short port, sf::Packet& packet,
+        unsigned short& from);
+    void wake(unsigned short port);
+    void close(unsigned short port);
+
+public:
+
+    explicit LoopbackNetwork(const Settings& settings);
+
+    // Open an endpoint on the given port, or any free port if 0.
+    // Throws if the port is taken. The network must outlive it
+    std::unique_ptr<LoopbackTransport> open(unsigned short port = 0);
+
+    sf::Uint64 sent();
+    sf::Uint64 dropped();
+};
+
+// One endpoint on a LoopbackNetwork
+class LoopbackTransport : public Transport
+{
+private:
+
+    LoopbackNetwork* mNetwork;
+    unsigned short mPort;
+
+public:
+
+    LoopbackTransport(LoopbackNetwork* network, unsigned short port);
+    ~LoopbackTransport();
+
+    sf::Socket::Status send(sf::Packet& packet,
+        const sf::IpAddress& remoteAddress, unsigned short remotePort);
+    // Gives up after a short wait so the caller can check if it
+    // should stop
+    sf::Socket::Status receive(sf::Packet& packet,
+        sf::IpAddress& remoteAddress, unsigned short& remotePort);
+    void wake() { mNetwork->wake(mPort); }
+    unsigned short getLocalPort() const { return mPort; }
+    sf::IpAddress getAddressFor(const sf::IpAddress& remoteAddress) const
+    {
+        return sf::IpAddress::LocalHost;
+    }
+};
+
+#endif /* LOOPBACK_TRANSPORT_HPP */
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+
+#include "lz.hpp"
+
+namespace
+{
+const size_t minMatch = 4;
+const size_t maxOffset = 65535;
+const unsigned int hashBits = 12;
+
+sf::Uint32 read32(const std::string& s, size_t pos)
+{
+    sf::Uint32 v;
+    std::memcpy(&v, &s[pos], sizeof(v));
+    return v;
+}
+
+unsigned int hash(sf::Uint32 v)
+{
+    return (v * 2654435761u) >> (32 - hashBits);
+}
+
+// Lengths which don't fit in their half of the token continue in
+// bytes of 255 until one which is smaller
+void writeLength(std::string& out, size_t length)
+{
+    for(; length >= 255; length -= 255) out.push_back(static_cast<char>(255));
+    out.push_back(static_cast<char>(length));
+}
+
+bool readLength(const std::string& in, size_t& pos, size_t& length)
+{
+    while(true)
+    {
+        if(pos >= in.size()) return false;
+        unsigned char b = in[pos++];
+        length += b;
+        if(b != 255) return true;
+    }
+}
+
+void writeSequence(std::string& out, const std::string& in, size_t anchor,
+    size_t literals, size_t offset, size_t match)
+{
+    size_t extra = match < minMatch ? 0 : match - minMatch;
+    unsigned char token = (std::min<size_t>(literals, 15) << 4);
+    if(match > 0) token |= std::min<size_t>(extra, 15);
+    out.push_back(static_cast<char>(token));
+    if(literals >= 15) writeLength(out, literals - 15);
+    out.append(in, anchor, literals);
+    // The last sequence is only literals
+    if(match == 0) return;
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if(extra >= 15) writeLength(out, extra - 15);
+}
+}
+
+namespace lz
+{
+std::string compress(const std::string& data)
+{
+    std::string out;
+    out.reserve(data.size() / 2 + 16);
+    // Last position each hash of four bytes was seen at
+    std::vector<int> table(1 << hashBits, -1);
+
+    size_t anchor = 0;
+    size_t i = 0;
+    while(i + minMatch <= data.size())
+    {
+        sf::Uint32 v = read32(data, i);
+        unsigned int h = hash(v);
+        int candidate = table[h];
+        table[h] = i;
+        if(candidate < 0 || i - candidate > maxOffset || read32(data, candidate) != v)
+        {
+            ++i;
+            continue;
+        }
+        size_t match = minMatch;
+        while(i + match < data.size() && data[candidate + match] == data[i + match]) ++match;
+        writeSequence(out, data, anchor, i - anchor, i - candidate, match);
+        i += match;
+        anchor = i;
+    }
+    writeSequence(out, data, anchor, data.size() - anchor, 0, 0);
+    return out;
+}
+
+bool decompress(const std::string& data, size_t size, std::string& out)
+{
+    out.clear();
+    out.reserve(size);
+    size_t pos = 0;
+    while(pos < data.size())
+    {
+        unsigned char token = data[pos++];
+        size_t literals = token >> 4;
+        if(literals == 15 && !readLength(data, pos, literals)) return false;
+        if(literals > data.size() - pos || out.size() + literals > size) return false;
+        out.append(data, pos, literals);
+        pos += literals;
+        if(pos == data.size()) break;
+
+        if(data.size() - pos < 2) return false;
+        size_t offset = static_cast<unsigned char>(data[pos]) |
+            (static_cast<unsigned char>(data[pos + 1]) << 8);
+        pos += 2;
+        size_t match = token & 15;
+        if(match == 15 && !readLength(data, pos, match)) return false;
+        match += minMatch;
+        if(offset == 0 || offset > out.size() || out.size() + match > size) return false;
+        // Copies may overlap what they're writing, which repeats it
+        size_t from = out.size() - offset;
+        for(size_t j = 0; j < match; ++j) out.push_back(out[from + j]);
+    }
+    return out.size() == size;
+}
+}
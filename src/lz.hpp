@@ -0,0 +1,21 @@
+#ifndef LZ_HPP
+#define LZ_HPP
+
+#include <string>
+
+// Fast byte oriented compression in the style of LZ4. The output is a
+// series of sequences, each a run of literal bytes followed by a copy
+// of earlier output, which decompresses with nothing but memcpy-like
+// loops. Ratios are modest but it's cheap enough to run on the tick
+// thread
+namespace lz
+{
+// Compress data of any size
+std::string compress(const std::string& data);
+
+// Decompress data which decompresses to exactly size bytes. Returns
+// false if it's malformed, so untrusted input is safe to pass
+bool decompress(const std::string& data, size_t size, std::string& out);
+}
+
+#endif /* LZ_HPP */
@@ -1,31 +1,43 @@
+#ifndef LD_HEADLESS
 #include <SFML/Window.hpp>
 #include <SFML/Graphics.hpp>
+#endif
 #include <SFML/Network.hpp>
 #include <SFML/System.hpp>
 #include <iostream>
 #include <memory>
 #include <thread>
+#include <atomic>
 #include <vector>
 #include <ctime>
 #include <cstdlib>
+#include <string>
 #include <JsonBox.h>
 #include <algorithm>
 
 #include "constants.hpp"
+#ifndef LD_HEADLESS
 #include "game_state.hpp"
 #include "game_state_title.hpp"
 #include "game_state_game.hpp"
+#endif
 #include "entity_manager.hpp"
 #include "network_manager.hpp"
 #include "game_container.hpp"
+#include "snapshot.hpp"
+#include "join_state.hpp"
+#include "server.hpp"
+#include "lobby.hpp"
+#include "relay.hpp"
 
 class Tileset;
 class GameMap;
 class Character;
 
 // Easiest way to ensure a otherwise infinite looping function
-// will halt is to use a pointer as a kill-switch
-void pollNetworkEvents(NetworkManager* nmgr, bool* kill)
+// will halt is to use a pointer as a kill-switch. waitEvent gives up
+// when woken, so the flag is seen as soon as it's set
+void pollNetworkEvents(NetworkManager* nmgr, std::atomic<bool>* kill)
 {
     // Run until killed, accepting connections and parsing them
     // as network events. The events are available from nmgr
@@ -36,25 +48,24 @@ void pollNetworkEvents(NetworkManager* nmgr, bool* kill)
     }
 }
 
-// Get the key for connected clients from a client charId and gameId
-// These are used in NetEvents to uniquely identify each client so as
-// to not broadcast ip and port to other clients. It also allows
-// multiple connections from the same ip
-sf::Uint32 clientKey(const sf::Uint16 gameId, const sf::Uint8 charId)
-{
-    return sf::Uint32(gameId << 8) + sf::Uint32(charId);
-}
-
 int main(int argc, char* argv[])
 {
     // Check for a server or a client
     // Should really make two different executables, but
     // there's not really enough time for that
     // TODO: Implement arguments instead of this
+    // "lobby" runs the router in front of several shards, and
+    // "shard <port>" runs one of them. "relay" streams a server's games
+    // to spectators. Anything else is a standalone server
+    std::string mode = argc > 1 ? argv[1] : "";
     if(argc > 1)
     {
         ld::isServer = true;
     }
+#ifdef LD_HEADLESS
+    // Built without the client, so there's nothing else it can be
+    ld::isServer = true;
+#endif
 
     std::srand(std::time(nullptr));
 
@@ -67,270 +78,47 @@ int main(int argc, char* argv[])
     // Load network manager
     JsonBox::Value configFile;
     configFile.loadFromFile("config.json");
-    NetworkManager networkManager(configFile[ld::isServer ? "server" : "client"]);
+    if(configFile.getObject().count("log") > 0)
+    {
+        Logger::instance().load(configFile["log"]);
+    }
+    JsonBox::Value netConfig = configFile[ld::isServer ? "server" : "client"];
+    if(mode == "lobby" || mode == "relay")
+    {
+        netConfig = configFile[mode];
+    }
+    else if(mode == "shard" && argc > 2)
+    {
+        // Same as a standalone server, but on the port the lobby gave
+        // it and reporting back to the lobby
+        netConfig["port"] = JsonBox::Value(std::atoi(argv[2]));
+        netConfig["lobby"] = configFile["lobby"];
+    }
+    NetworkManager networkManager(netConfig, ld::isServer);
 
     // Open a thread for listening to incoming connections
-    bool killPollNetworkThread = false;
+    std::atomic<bool> killPollNetworkThread(false);
     std::thread pollNetworkThread(pollNetworkEvents, &networkManager, &killPollNetworkThread);
 
     //////////////////////////////////////////////////////////////////
     // SERVER
     //////////////////////////////////////////////////////////////////
-    if(ld::isServer)
+    if(mode == "lobby")
     {
-        bool running = true;
-        // Currently connected clients. Indexed by a hash of their
-        // gameId and charId (see clientKey)
-        struct ClientInfo {
-            sf::IpAddress ip;
-            sf::Uint16 port;
-            sf::Uint16 gameId;
-            sf::Uint8 charId;
-        };
-        std::map<sf::Uint32, ClientInfo> connectedClients;
-        // Games currently running on this server
-        std::map<sf::Uint16, GameContainer> games;
-
-        // Game time
-        sf::Clock clock;
-
-        while(running)
-        {
-            float dt = clock.restart().asSeconds();
-
-            NetworkManager::Event netEvent;
-            while(networkManager.pollEvent(netEvent))
-            {
-                switch(netEvent.type)
-                {
-                    default:
-                    case NetworkManager::Event::Nop:
-                    {
-                        break;
-                    }
-                    ///////////////////////////////////////////////////
-                    // CONNECT
-                    ///////////////////////////////////////////////////
-                    case NetworkManager::Event::Connect:
-                    {
-                        auto& e = netEvent.connect;
-                        if(std::find_if(connectedClients.begin(), connectedClients.end(),
-                            [&e](const std::pair<sf::Uint32, ClientInfo>& a)
-                            {
-                                return a.second.ip == e.ip && a.second.port == e.port;
-                            }) != connectedClients.end())
-                        {
-                            servout << e.ip.toString() << ":" << e.port << " is already connected" << std::endl;
-                        }
-                        else
-                        {
-                            // If the game doesn't exist yet, make it
-                            if(games.count(e.gameId) == 0)
-                            {
-                                games[e.gameId] = GameContainer(entityManager.getEntity<GameMap>("gamemap_5v5"), e.gameId, 255);
-                            }
-                            GameContainer& game = games[e.gameId];
-                            // Attempt to add to a team
-                            // TODO: Add team choosing
-                            sf::Uint8 charId = 255;
-                            if(game.add("character_fighter", GameContainer::Team::Any, &entityManager, &charId))
-                            {
-                                auto ck = clientKey(e.gameId, charId);
-                                // Added to the team, send a success
-                                // message to connected clients
-                                servout << e.ip.toString() << ":" << e.port << " has connected to game "
-                                    << e.gameId << " as character " << (sf::Uint16)charId << std::endl;
-                                // Add to the list of connected clients
-                                connectedClients[ck] = (ClientInfo){
-                                    .ip = e.ip,
-                                    .port = e.port,
-                                    .gameId = e.gameId,
-                                    .charId = charId
-                                };
-                                // Send an accept to the client who tried
-                                // to connect
-                                e.team = game.characters[charId].team;
-                                e.charId = charId;
-                                networkManager.send(netEvent, e.ip, e.port);
-                                // Tell the connecting client about existing
-                                // clients in the same game
-                                for(auto c : connectedClients)
-                                {
-                                    if(c.second.gameId != connectedClients[ck].gameId || c.first == ck) continue;
-                                    // Shorthand reference to character
-                                    auto ch = games[e.gameId].characters[c.second.charId];
-                                    NetworkManager::Event response;
-                                    // Connection information
-                                    response.connect = {
-                                        .ip = sf::IpAddress(0, 0, 0, 0),
-                                        .port = 0,
-                                        .gameId = c.second.gameId,
-                                        .charId = c.second.charId,
-                                        .team = ch.team
-                                    };
-                                    response.type = NetworkManager::Event::Connect;
-                                    networkManager.send(response, e.ip, e.port);
-                                    // Position information
-                                    response.move = {
-                                        .gameId = c.second.gameId,
-                                        .charId = c.second.charId,
-                                        .target = ch.c.pfHelper.target,
-                                        .pos = ch.c.pfHelper.pos
-                                    };
-                                    response.type = NetworkManager::Event::Move;
-                                    networkManager.send(response, e.ip, e.port);
-                                }
-                                // Send to other clients who are in the same game
-                                // Ip and port are not needed by other
-                                // clients, and so are masked
-                                e.ip = sf::IpAddress(0, 0, 0, 0);
-                                e.port = 0;
-                                for(auto c : connectedClients)
-                                {
-                                    // Don't send it to client who requested
-                                    // or clients who are not in the same game
-                                    if(c.second.gameId != connectedClients[ck].gameId || c.first == ck) continue;
-                                    networkManager.send(netEvent, c.second.ip, c.second.port);
-                                    servout << "\tNotified " << c.second.ip.toString() << ":" << c.second.port << std::endl;
-                                }
-                            }
-                            else
-                            {
-                                // Couldn't add, so respond with
-                                // a failure message
-                                // TODO: When you're 8 indents in,
-                                // it's probably time to refactor
-                                NetworkManager::Event response;
-                                response.gameFull = {
-                                    .gameId = e.gameId
-                                };
-                                response.type = NetworkManager::Event::GameFull;
-                                servout << "Game " << e.gameId
-                                    << " is full, rejecting with message" << std::endl;
-                                networkManager.send(response, e.ip, e.port);
-                            }
-                        }
-                        break;
-                    }
-                    ///////////////////////////////////////////////////
-                    // DISCONNECT
-                    ///////////////////////////////////////////////////
-                    case NetworkManager::Event::Disconnect:
-                    {
-                        // Terribly unsecure way of killing server gracefully
-                        if(netEvent.disconnect.gameId == 65535 &&
-                            netEvent.disconnect.charId == 255)
-                        {
-                            running = false;
-                        }
-                        // Same as a connect event but in reverse
-                        auto& e = netEvent.disconnect;
-                        auto ck = clientKey(e.gameId, e.charId);
-                        if(connectedClients.count(ck) == 0)
-                        {
-                            servout << e.ip.toString() << " is not connected" << std::endl;
-                        }
-                        // TODO: This section should also be triggered if a client has not been
-                        // heard from for a certain amount of time
-                        // Double check that the information given by the
-                        // client is correct
-                        else if(connectedClients[ck].gameId == e.gameId &&
-                            connectedClients[ck].charId == e.charId &&
-                            connectedClients[ck].ip == e.ip &&
-                            connectedClients[ck].port == e.port)
-                        {
-                            servout << e.ip.toString() << " has disconnected" << std::endl;
-                            // Delete from the set of connected clients
-                            connectedClients.erase(ck);
-                            // Broacast
-                            e.ip = sf::IpAddress(0, 0, 0, 0);
-                            e.port = 0;
-                            for(auto c : connectedClients)
-                            {
-                                if(c.second.gameId != e.gameId) continue;
-                                networkManager.send(netEvent, c.second.ip, c.second.port);
-                            }
-                        }
-
-                        break;
-                    }
-                    ///////////////////////////////////////////////////
-                    // MOVE
-                    ///////////////////////////////////////////////////
-                    case NetworkManager::Event::Move:
-                    {
-                        auto& e = netEvent.move;
-                        auto ck = clientKey(e.gameId, e.charId);
-
-                        auto& ch = games[e.gameId].characters[e.charId].c;
-                        // If the client position is slightly different to
-                        // server position, accept the client as truth
-                        // If it's wildly different, accept the server
-                        bool changeClient = false;
-                        if(vecmath::norm(ch.pfHelper.pos-e.pos) < 0.1) ch.pfHelper.pos = e.pos;
-                        else
-                        {
-                            changeClient = true;
-                            e.pos = ch.pfHelper.pos;
-                        }
-                        // Change the target
-                        ch.pfHelper.setTarget(e.target);
-
-                        // Now that corrections have been made, broadcast
-                        // to all clients in the game, but only broadcast
-                        // to the sender if they had their position changed
-                        for(auto c : connectedClients)
-                        {
-                            if(c.second.gameId != e.gameId ||
-                                (changeClient == false && c.first == ck)) continue;
-                            networkManager.send(netEvent, c.second.ip, c.second.port);
-                        }
-                        servout << ck << " sent a move event" << std::endl;
-                        break;
-                    }
-                    ///////////////////////////////////////////////////
-                    // DAMAGE
-                    ///////////////////////////////////////////////////
-                    // TODO
-                    case NetworkManager::Event::Damage:
-                    {
-                        auto& e = netEvent.move;
-                        auto ck = clientKey(e.gameId, e.charId);
-                        break;
-                    }
-                    ///////////////////////////////////////////////////
-                    // AUTO ATTACK
-                    ///////////////////////////////////////////////////
-                    // TODO
-                    case NetworkManager::Event::AutoAttack:
-                    {
-                        auto& e = netEvent.autoAttack;
-                        auto ck = clientKey(e.gameId, e.charId);
-                        break;
-                    }
-                }
-            }
-            for(auto& g : games)
-            {
-                // Process parts of the game which result in events being sent
-                for(auto attack : g.second.targetAttacks)
-                {
-                    if(attack->update(dt))
-                    {
-                        // Attack has triggered, so tell the clients about it
-                        NetworkManager::Event netEvent = attack->getEvent();
-                        for(auto c : connectedClients)
-                        {
-                            if(c.second.gameId != g.first) continue;
-                            networkManager.send(netEvent, c.second.ip, c.second.port);
-                        }
-                    }
-                }
-                // Process the gameplay
-                g.second.update(dt);
-            }
-        }
+        Lobby lobby(configFile["lobby"], &networkManager, argv[0]);
+        lobby.run();
+    }
+    else if(mode == "relay")
+    {
+        Relay relay(configFile["relay"], &networkManager);
+        relay.run();
     }
+    else if(ld::isServer)
+    {
+        Server server(netConfig, &networkManager, &entityManager);
+        server.run();
+    }
+#ifndef LD_HEADLESS
     //////////////////////////////////////////////////////////////////
     // CLIENT
     //////////////////////////////////////////////////////////////////
@@ -375,6 +163,25 @@ int main(int argc, char* argv[])
             window.close();
         }
         bool hasConnectedToServer = false;
+        // The state of the game we're joining can overtake the Connect
+        // which accepts us, in which case it waits here
+        NetworkManager::Event pendingJoin;
+
+        // Snapshots received from the server, used as baselines to
+        // decode later deltas
+        SnapshotHistory snapshots;
+        sf::Uint32 latestSnapshot = 0;
+
+        // Other characters are drawn this many seconds in the past, so
+        // there is usually a snapshot either side to interpolate between
+        float interpolationDelay = cts_client.count("interpolationDelay") > 0 ?
+            cts_client["interpolationDelay"].tryGetFloat(0.1f) : 0.1f;
+
+        // Let the server know we're still here, even if we're not doing
+        // anything, so it doesn't time us out
+        float keepaliveInterval = cts_client.count("keepaliveInterval") > 0 ?
+            cts_client["keepaliveInterval"].tryGetFloat(1.0f) : 1.0f;
+        sf::Clock keepaliveClock;
 
         // Game loop
         while(window.isOpen())
@@ -424,7 +231,11 @@ int main(int argc, char* argv[])
                             // Add the client to the game, with the
                             // position and team as given by the server
                             game->add("character_fighter", e.team, &entityManager, &e.charId);
-                            // TODO: Add other players
+                            if(pendingJoin.state != nullptr && pendingJoin.joinState.gameId == e.gameId)
+                            {
+                                pendingJoin.state->apply(*game, &entityManager);
+                            }
+                            pendingJoin.state.reset();
                             state.reset(new GameStateGame(state, state, game, &entityManager, &networkManager));
                         }
                         // Otherwise if this concerns the game the client
@@ -433,6 +244,10 @@ int main(int argc, char* argv[])
                         {
                             // Server says a new player has joined the game
                             clntout << "\tConnected to my game on team " << static_cast<int>(e.team) << std::endl;
+                            // Anyone we still have in this slot has left,
+                            // otherwise the newcomer would be given another
+                            if(e.charId == game->client) break;
+                            game->remove(e.charId);
                             game->add("character_fighter", e.team, &entityManager, &e.charId);
                         }
                         break;
@@ -444,6 +259,10 @@ int main(int argc, char* argv[])
                     {
                         auto e = netEvent.disconnect;
                         clntout << e.ip.toString() << " has disconnected" << std::endl;
+                        if(game != nullptr && e.gameId == game->gameId && e.charId != game->client)
+                        {
+                            game->remove(e.charId);
+                        }
                         break;
                     }
                     ///////////////////////////////////////////////////
@@ -457,16 +276,45 @@ int main(int argc, char* argv[])
                         break;
                     }
                     ///////////////////////////////////////////////////
+                    // REDIRECT
+                    ///////////////////////////////////////////////////
+                    case NetworkManager::Event::Redirect:
+                    {
+                        auto e = netEvent.redirect;
+                        if(hasConnectedToServer) break;
+                        // The lobby doesn't run games itself, so join
+                        // again on the shard running ours
+                        sf::IpAddress ip = e.ip == sf::IpAddress(0, 0, 0, 0) ?
+                            sf::IpAddress(cts_target["address"].getString()) : e.ip;
+                        clntout << "Redirected to " << ip.toString() << ":" << e.port << std::endl;
+                        if(!networkManager.connectToServer(ip, e.port, e.gameId))
+                        {
+                            window.close();
+                        }
+                        break;
+                    }
+                    ///////////////////////////////////////////////////
                     // MOVE
                     ///////////////////////////////////////////////////
                     case NetworkManager::Event::Move:
                     {
                         auto e = netEvent.move;
                         if(game == nullptr || e.gameId != game->gameId) break;
+                        if(game->characters.count(e.charId) == 0) break;
                         // Accept position and target changes from the server
-                        auto& ch = game->characters[e.charId].c;
-                        ch.pfHelper.pos = e.pos;
-                        ch.pfHelper.setTarget(e.target);
+                        if(e.charId == game->client)
+                        {
+                            // The server disagreed with where we said we
+                            // were, so start again from its position and
+                            // replay the orders it hasn't seen yet
+                            float speed = game->store.moveSpeed[game->indexOf(e.charId)];
+                            game->prediction.reconcile(game->characters[e.charId].pfHelper,
+                                speed, e.sequence, e.pos);
+                            game->sync(e.charId);
+                            break;
+                        }
+                        game->setPos(e.charId, e.pos);
+                        game->setTarget(e.charId, e.target);
                         break;
                     }
                     ///////////////////////////////////////////////////
@@ -477,6 +325,84 @@ int main(int argc, char* argv[])
                         break;
                     }
                     ///////////////////////////////////////////////////
+                    // SNAPSHOT
+                    ///////////////////////////////////////////////////
+                    case NetworkManager::Event::Snapshot:
+                    {
+                        auto e = netEvent.snapshot;
+                        if(game == nullptr || e.gameId != game->gameId) break;
+                        // Stale snapshots are useless, and deltas against
+                        // a snapshot we don't have can't be decoded
+                        const Snapshot& delta = *netEvent.delta;
+                        if(delta.sequence <= latestSnapshot) break;
+                        const Snapshot* baseline = snapshots.get(delta.baseline);
+                        if(delta.baseline != 0 && baseline == nullptr) break;
+                        Snapshot full = baseline == nullptr ? delta : delta.merge(*baseline);
+                        for(const auto& d : delta.characters)
+                        {
+                            sf::Uint8 charId = d.first;
+                            if(charId == game->client) continue;
+                            if(d.second.fields & Snapshot::Field::Removed)
+                            {
+                                game->remove(charId);
+                            }
+                            // A lost Connect would otherwise leave this
+                            // character missing forever. Only what the
+                            // server just sent counts, the baseline may
+                            // still have characters we've seen leave
+                            else if(game->characters.count(charId) == 0)
+                            {
+                                game->add("character_fighter", full.characters.at(charId).team,
+                                    &entityManager, &charId);
+                            }
+                        }
+                        for(const auto& s : full.characters)
+                        {
+                            sf::Uint8 charId = s.first;
+                            // Either the game is full or it never arrived
+                            if(game->characters.count(charId) == 0) continue;
+                            size_t i = game->indexOf(charId);
+                            game->store.hp[i] = s.second.hp;
+                            game->store.mp[i] = s.second.mp;
+                            // The client is authoritative over its own
+                            // movement, the server corrects it with a Move
+                            if(charId == game->client) continue;
+                            // Everyone else is interpolated between
+                            // snapshots. Unchanged characters still need
+                            // a sample, or they would be extrapolated
+                            game->store.heard(i, game->time, s.second.pos);
+                        }
+                        snapshots.store(full);
+                        latestSnapshot = full.sequence;
+                        // Let the server know it can delta against this
+                        NetworkManager::Event response;
+                        response.type = NetworkManager::Event::SnapshotAck;
+                        response.snapshotAck = {
+                            .gameId = game->gameId,
+                            .charId = game->client,
+                            .sequence = full.sequence
+                        };
+                        networkManager.send(response);
+                        break;
+                    }
+                    ///////////////////////////////////////////////////
+                    // JOIN STATE
+                    ///////////////////////////////////////////////////
+                    case NetworkManager::Event::JoinState:
+                    {
+                        auto e = netEvent.joinState;
+                        if(game == nullptr)
+                        {
+                            pendingJoin = netEvent;
+                            break;
+                        }
+                        if(e.gameId != game->gameId) break;
+                        clntout << "Received the state of game " << e.gameId << ", "
+                                << netEvent.state->characters.size() << " characters" << std::endl;
+                        netEvent.state->apply(*game, &entityManager);
+                        break;
+                    }
+                    ///////////////////////////////////////////////////
                     // AUTOATTACK
                     ///////////////////////////////////////////////////
                     case NetworkManager::Event::AutoAttack:
@@ -507,6 +433,22 @@ int main(int argc, char* argv[])
                 }
             }
 
+            if(game != nullptr) game->interpolate(interpolationDelay);
+
+            if(hasConnectedToServer &&
+                keepaliveClock.getElapsedTime().asSeconds() >= keepaliveInterval)
+            {
+                keepaliveClock.restart();
+                NetworkManager::Event keepalive;
+                keepalive.type = NetworkManager::Event::Keepalive;
+                keepalive.keepalive = {
+                    .gameId = game->gameId,
+                    .charId = game->client
+                };
+                networkManager.send(keepalive);
+            }
+            networkManager.update();
+
             if(state != nullptr)
             {
                 // Update window
@@ -529,9 +471,11 @@ int main(int argc, char* argv[])
             networkManager.disconnectFromServer(game->gameId, game->client);
         }
     }
+#endif
 
     // Kill the network thread and join
     killPollNetworkThread = true;
+    networkManager.wake();
     pollNetworkThread.join();
 
     return 0;
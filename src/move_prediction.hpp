@@ -0,0 +1,91 @@
+#ifndef MOVE_PREDICTION_HPP
+#define MOVE_PREDICTION_HPP
+
+#include <SFML/System.hpp>
+#include <deque>
+#include <vector>
+
+#include "pathfinding_helper.hpp"
+
+// Lets the client move its own character as soon as it gives an order,
+// instead of waiting to hear back from the server. Every Move sent is
+// numbered and remembered along with the length of each frame simulated
+// since, so when the server corrects the position it had for one of
+// them the client can start again from the server's position and
+// replay every order the server hasn't seen yet
+class MovePrediction
+{
+private:
+
+    struct Input
+    {
+        sf::Uint16 sequence;
+        sf::Vector2f target;
+        std::vector<float> frames;
+    };
+
+    // Limits on history, so a server that never replies doesn't
+    // leave us remembering everything
+    static const unsigned int maxInputs = 64;
+    static const unsigned int maxFrames = 256;
+
+    std::deque<Input> mInputs;
+    sf::Uint16 mNextSequence;
+
+    // Sequence numbers wrap, so compare them modulo 2^16
+    static bool before(sf::Uint16 a, sf::Uint16 b)
+    {
+        return static_cast<sf::Int16>(a - b) < 0;
+    }
+
+public:
+
+    MovePrediction() : mNextSequence(0) {}
+
+    // Remember a new order and return the sequence number to send it with
+    sf::Uint16 push(const sf::Vector2f& target)
+    {
+        if(mInputs.size() >= maxInputs) mInputs.pop_front();
+        mInputs.push_back((Input){ mNextSequence, target, std::vector<float>() });
+        return mNextSequence++;
+    }
+
+    // Remember a frame of simulation
+    void advance(float dt)
+    {
+        if(mInputs.empty()) return;
+        std::vector<float>& frames = mInputs.back().frames;
+        // Fold very old frames together rather than growing forever
+        if(frames.size() >= maxFrames) frames.back() += dt;
+        else frames.push_back(dt);
+    }
+
+    // The server had the character at pos when it handled the given
+    // order. Rewind to there and replay everything since. speed is in
+    // tiles per second
+    void reconcile(PathfindingHelper& pfHelper, float speed,
+        sf::Uint16 sequence, const sf::Vector2f& pos)
+    {
+        // Forget orders the server has already dealt with
+        while(!mInputs.empty() && before(mInputs.front().sequence, sequence))
+        {
+            mInputs.pop_front();
+        }
+        pfHelper.pos = pos;
+        // The order has been forgotten, so there's nothing to replay.
+        // The old path started somewhere else though, so head for the
+        // same place again from here
+        if(mInputs.empty() || mInputs.front().sequence != sequence)
+        {
+            pfHelper.setTarget(pfHelper.target);
+            return;
+        }
+        for(const auto& input : mInputs)
+        {
+            pfHelper.setTarget(input.target);
+            for(float dt : input.frames) pfHelper.update(dt * speed);
+        }
+    }
+};
+
+#endif /* MOVE_PREDICTION_HPP */
@@ -8,35 +8,98 @@
 #include <iostream>
 #include <cerrno>
 #include <cstring>
-#include <sstream>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <iterator>
 #include "network_manager.hpp"
-#include "constants.hpp"
+#include "udp_transport.hpp"
+#include "snapshot.hpp"
+#include "join_state.hpp"
+#include "rate_limiter.hpp"
 
-NetworkManager::NetworkManager(const JsonBox::Value& v)
+const char* const NetworkManager::typeNames[] = {
+    "Nop",
+    "Connect",
+    "Disconnect",
+    "GameFull",
+    "Move",
+    "Damage",
+    "AutoAttack",
+    "Snapshot",
+    "SnapshotAck",
+    "Keepalive",
+    "JoinState",
+    "Fragment",
+    "ShardReport",
+    "Redirect",
+    "Spectate"
+};
+static_assert(sizeof(NetworkManager::typeNames) / sizeof(const char*) ==
+    NetworkManager::Event::Count, "Every event type needs a name");
+static_assert(NetworkManager::Event::Count <= NetworkStats::maxTypes,
+    "NetworkStats needs room for every event type");
+
+NetworkManager::NetworkManager(const JsonBox::Value& v, bool isServer) :
+    mRemotePort(0),
+    mIsServer(isServer),
+    mNextFragmented(0),
+    mStrangers(1),
+    mLimiter(Event::Count)
 {
-    mPort = 49518;
+    mStrangers.setBudget(0, (RateLimiter::Budget){ 50.0f, 100.0f });
+    unsigned short port = 49518;
+    unsigned int sockets = 1;
     JsonBox::Object o = v.getObject();
     if(o.find("port") != o.end())
     {
-        mPort = o["port"].getInteger();
+        port = o["port"].getInteger();
+    }
+    if(o.find("sockets") != o.end())
+    {
+        sockets = o["sockets"].tryGetInteger(sockets);
     }
 
-    // Open UDP socket
-    if(mSocket.bind(mPort) != sf::Socket::Done)
+    // Open UDP sockets
+    mTransport.reset(new UdpTransport(port, sockets));
+    mPort = mTransport->getLocalPort();
+    if(mIsServer) servout << "Bound to port " << mPort << std::endl;
+    else          clntout << "Bound to port " << mPort << std::endl;
+
+    if(o.find("capture") != o.end())
     {
-        throw std::runtime_error("Failed to open socket on port "
-            + std::to_string(mPort));
+        startCapture(o["capture"].getString());
+    }
+    if(o.find("stats") != o.end())
+    {
+        JsonBox::Object statsO = o["stats"].getObject();
+        float interval = statsO.count("interval") > 0 ?
+            statsO["interval"].tryGetFloat(1.0f) : 1.0f;
+        if(statsO.count("file") > 0)
+        {
+            startStatsDump(statsO["file"].getString(), interval);
+        }
+    }
+    if(o.find("rateLimits") != o.end())
+    {
+        setRateLimits(o["rateLimits"]);
     }
-    mPort = mSocket.getLocalPort();
-    if(ld::isServer) servout << "Bound to port " << mPort << std::endl;
-    else             clntout << "Bound to port " << mPort << std::endl;
 }
 
-NetworkManager::NetworkManager() : mPort(49518), mRemotePort(0) {}
+NetworkManager::NetworkManager(std::unique_ptr<Transport> transport, bool isServer) :
+    mPort(transport->getLocalPort()),
+    mTransport(std::move(transport)),
+    mRemotePort(0),
+    mIsServer(isServer),
+    mNextFragmented(0),
+    mStrangers(1),
+    mLimiter(Event::Count)
+{
+    mStrangers.setBudget(0, (RateLimiter::Budget){ 50.0f, 100.0f });
+}
 
 NetworkManager::~NetworkManager()
 {
-    mSocket.unbind();
 }
 
 bool NetworkManager::connectToServer(const sf::IpAddress &remoteAddress,
@@ -44,35 +107,9 @@ bool NetworkManager::connectToServer(const sf::IpAddress &remoteAddress,
     sf::Uint16 gameId)
 {
     // Bail if server is connecting to server
-    if(ld::isServer) return false;
+    if(mIsServer) return false;
 
-    // Work out if this is the remote address is WAN or LAN
-    // This is not great and probably doesn't actually work,
-    // it just assumes an IP is local iff it's in reserved in RFC1918.
-    // Needed because the address is used in events to identify the host.
-    // Note that this does not support a situation where people are connected
-    // to the same server with some on LAN and some on WAN, but this solution
-    // is simple and that's all I care about for now
-    // TODO: Support simultaneous LAN & WAN connections
-    std::string ipStr = remoteAddress.toString();
-    for(int i = 0; i < ipStr.size(); ++i)
-    {
-        if(ipStr[i] == '.') ipStr[i] = ' ';
-    }
-    std::istringstream ipStrIs(ipStr);
-    int blocks[4] = {0,0,0,0};
-    ipStrIs >> blocks[0] >> blocks[1] >> blocks[2] >> blocks[3];
-    if(remoteAddress == sf::IpAddress::LocalHost ||
-        blocks[0] == 10 ||
-        (blocks[0] == 172 && 16 <= blocks[1] && blocks[1] <= 31) ||
-        (blocks[0] == 192 && blocks[1] == 168))
-    {
-        mIp = sf::IpAddress::getLocalAddress();
-    }
-    else
-    {
-        mIp = sf::IpAddress::getPublicAddress();
-    }
+    mIp = mTransport->getAddressFor(remoteAddress);
 
     Event e;
     e.connect = {
@@ -100,7 +137,7 @@ bool NetworkManager::connectToServer(const sf::IpAddress &remoteAddress,
 
 bool NetworkManager::disconnectFromServer(sf::Uint16 gameId, sf::Uint8 charId)
 {
-    if(ld::isServer) return false;
+    if(mIsServer) return false;
 
     Event e;
     e.disconnect = {
@@ -122,6 +159,49 @@ bool NetworkManager::disconnectFromServer(sf::Uint16 gameId, sf::Uint8 charId)
     return true;
 }
 
+void NetworkManager::startCapture(const std::string& path)
+{
+    mCapture.reset(new CaptureWriter(path));
+    if(mIsServer) servout << "Capturing packets to " << path << std::endl;
+    else          clntout << "Capturing packets to " << path << std::endl;
+}
+
+void NetworkManager::startStatsDump(const std::string& path, float interval)
+{
+    mStatsFile.open(path, std::ios::app);
+    if(!mStatsFile)
+    {
+        throw std::runtime_error("Failed to open stats file " + path);
+    }
+    mStatsInterval = sf::seconds(interval);
+    mNextStatsDump = mClock.getElapsedTime();
+}
+
+void NetworkManager::setRateLimits(const JsonBox::Value& v)
+{
+    std::lock_guard<std::mutex> lock(mLimiterMutex);
+    mLimiter.load(v, typeNames);
+}
+
+std::vector<NetworkStats::Peer> NetworkManager::getPeers()
+{
+    std::vector<NetworkStats::Peer> peers;
+    std::lock_guard<std::mutex> lock(mConnectionsMutex);
+    for(const auto& c : mConnections)
+    {
+        sf::IpAddress ip(static_cast<sf::Uint32>(c.first >> 16));
+        unsigned short port = static_cast<unsigned short>(c.first & 0xffff);
+        peers.push_back((NetworkStats::Peer){
+            ip.toString() + ":" + std::to_string(port),
+            c.second.rtt(),
+            c.second.loss(),
+            c.second.lost(),
+            c.second.pending()
+        });
+    }
+    return peers;
+}
+
 unsigned short NetworkManager::getPort() const
 {
     return mPort;
@@ -137,6 +217,7 @@ sf::Socket::Status NetworkManager::send(const Event& event,
     const sf::IpAddress& remoteAddress,
     unsigned short remotePort)
 {
+    sf::Clock serializeClock;
     sf::Packet packet;
     packet << static_cast<sf::Uint16>(event.type);
     switch(event.type)
@@ -163,7 +244,8 @@ sf::Socket::Status NetworkManager::send(const Event& event,
             packet << event.move.gameId
                    << event.move.charId
                    << event.move.target
-                   << event.move.pos;
+                   << event.move.pos
+                   << event.move.sequence;
             break;
         case Event::Damage:
             packet << event.damage.gameId
@@ -176,9 +258,157 @@ sf::Socket::Status NetworkManager::send(const Event& event,
                    << event.autoAttack.targetId
                    << event.autoAttack.cancel;
             break;
+        case Event::Snapshot:
+            if(event.delta == nullptr) return sf::Socket::Error;
+            packet << event.snapshot.gameId;
+            event.delta->write(packet);
+            break;
+        case Event::SnapshotAck:
+            packet << event.snapshotAck.gameId
+                   << event.snapshotAck.charId
+                   << event.snapshotAck.sequence;
+            break;
+        case Event::Keepalive:
+            packet << event.keepalive.gameId
+                   << event.keepalive.charId;
+            break;
+        case Event::JoinState:
+            if(event.state == nullptr) return sf::Socket::Error;
+            packet << event.joinState.gameId;
+            event.state->write(packet);
+            break;
+        case Event::ShardReport:
+            packet << event.shardReport.port
+                   << event.shardReport.games
+                   << event.shardReport.players
+                   << event.shardReport.load;
+            break;
+        case Event::Redirect:
+            packet << event.redirect.gameId
+                   << event.redirect.ip.toInteger()
+                   << event.redirect.port;
+            break;
+        case Event::Spectate:
+            packet << event.spectate.ip.toInteger()
+                   << event.spectate.port
+                   << event.spectate.gameId
+                   << event.spectate.viewerId
+                   << event.spectate.leave;
+            break;
         default: return sf::Socket::Error;
     }
-    return mSocket.send(packet, remoteAddress, remotePort);
+
+    if(packet.getDataSize() > maxDatagramBody)
+    {
+        // Another will be along soon, hopefully smaller
+        if(!isReliable(event.type))
+        {
+            mStats.dropped(event.type);
+            if(mIsServer)
+            {
+                servlog(Warn, "send") << typeNames[event.type] << " of "
+                    << packet.getDataSize() << " bytes is too big to send" << std::endl;
+            }
+            else
+            {
+                clntlog(Warn, "send") << typeNames[event.type] << " of "
+                    << packet.getDataSize() << " bytes is too big to send" << std::endl;
+            }
+            return sf::Socket::Error;
+        }
+        // The fragments are counted as they go
+        mStats.serialized(event.type, serializeClock.getElapsedTime());
+        return sendFragmented(packet, remoteAddress, remotePort);
+    }
+
+    // Number the packet and add our acks to it
+    sf::Packet wrapped;
+    {
+        std::lock_guard<std::mutex> lock(mConnectionsMutex);
+        Connection& connection = mConnections[addressKey(remoteAddress, remotePort)];
+        connection.answer();
+        wrapped = connection.wrap(packet, isReliable(event.type), mClock.getElapsedTime());
+    }
+    mStats.sent(event.type, wrapped.getDataSize(), serializeClock.getElapsedTime());
+    return mTransport->send(wrapped, remoteAddress, remotePort);
+}
+
+sf::Socket::Status NetworkManager::sendFragmented(const sf::Packet& packet,
+    const sf::IpAddress& remoteAddress, unsigned short remotePort)
+{
+    const char* data = static_cast<const char*>(packet.getData());
+    size_t size = packet.getDataSize();
+    // Room for the fragment header, and the string's length
+    const size_t part = maxDatagramBody - 16;
+    size_t count = (size + part - 1) / part;
+    if(count > 255) return sf::Socket::Error;
+
+    // Every fragment is reliable, since losing one loses the lot
+    std::vector<sf::Packet> wrapped;
+    {
+        std::lock_guard<std::mutex> lock(mConnectionsMutex);
+        sf::Uint16 id = mNextFragmented++;
+        Connection& connection = mConnections[addressKey(remoteAddress, remotePort)];
+        connection.answer();
+        for(size_t i = 0; i < count; ++i)
+        {
+            size_t offset = i * part;
+            sf::Packet fragment;
+            fragment << static_cast<sf::Uint16>(Event::Fragment) << id
+                     << static_cast<sf::Uint8>(i) << static_cast<sf::Uint8>(count)
+                     << std::string(data + offset, std::min(part, size - offset));
+            wrapped.push_back(connection.wrap(fragment, true, mClock.getElapsedTime()));
+        }
+    }
+    sf::Socket::Status status = sf::Socket::Done;
+    for(auto& p : wrapped)
+    {
+        mStats.sent(Event::Fragment, p.getDataSize(), sf::Time::Zero);
+        sf::Socket::Status s = mTransport->send(p, remoteAddress, remotePort);
+        // The rest are worth sending anyway, as they'll be resent
+        if(s != sf::Socket::Done) status = s;
+    }
+    return status;
+}
+
+bool NetworkManager::reassemble(sf::Packet& fragment, sf::Uint64 sender, sf::Packet& packet)
+{
+    sf::Uint16 id = 0;
+    sf::Uint8 index = 0;
+    sf::Uint8 count = 0;
+    std::string part;
+    if(!(fragment >> id >> index >> count >> part) || index >= count) return false;
+
+    std::lock_guard<std::mutex> lock(mConnectionsMutex);
+    FragmentKey key(sender, id);
+    auto it = mFragments.find(key);
+    if(it == mFragments.end())
+    {
+        // Make room by giving up on the sender's oldest packet
+        auto first = mFragments.lower_bound(FragmentKey(sender, 0));
+        auto last = mFragments.upper_bound(FragmentKey(sender, 0xffff));
+        if(static_cast<unsigned int>(std::distance(first, last)) >= maxReassemblies)
+        {
+            auto oldest = first;
+            for(auto f = first; f != last; ++f)
+            {
+                if(f->second.started < oldest->second.started) oldest = f;
+            }
+            mFragments.erase(oldest);
+        }
+        it = mFragments.insert(std::make_pair(key, (Reassembly){
+            std::vector<std::string>(count), 0, mClock.getElapsedTime()
+        })).first;
+    }
+    Reassembly& r = it->second;
+    if(r.parts.size() != count || !r.parts[index].empty()) return false;
+    r.parts[index] = part;
+    if(++r.received < count) return false;
+
+    packet.clear();
+    for(const auto& p : r.parts) packet.append(p.data(), p.size());
+    mFragments.erase(it);
+    return true;
 }
 
 sf::Socket::Status NetworkManager::send(const Event& event)
@@ -189,6 +419,7 @@ sf::Socket::Status NetworkManager::send(const Event& event)
 sf::Socket::Status NetworkManager::sendSelf(const Event& event)
 {
     // Could send this through localhost, but there's really no point
+    std::lock_guard<std::mutex> lock(mEventQueueMutex);
     mEventQueue.push(event);
     return sf::Socket::Done;
 }
@@ -196,9 +427,11 @@ sf::Socket::Status NetworkManager::sendSelf(const Event& event)
 // Take the next event out of the event queue
 bool NetworkManager::pollEvent(Event& event)
 {
+    std::lock_guard<std::mutex> lock(mEventQueueMutex);
     if(mEventQueue.empty()) return false;
     event = mEventQueue.front();
     mEventQueue.pop();
+    mStats.queueDepth(mEventQueue.size());
     return true;
 }
 
@@ -212,21 +445,74 @@ bool NetworkManager::waitEvent()
     
     // Wait for an incoming connection
     sf::Socket::Status returnCode;
-    if((returnCode = mSocket.receive(packet, sender, port)) != sf::Socket::Done)
+    if((returnCode = mTransport->receive(packet, sender, port)) != sf::Socket::Done)
     {
-        if(ld::isServer)
+        // Nothing arrived in time, or we were woken, which isn't an error
+        if(returnCode == sf::Socket::NotReady) return false;
+        // Errors are usually about one bad datagram, so carry straight
+        // on rather than stalling. The log's rate limit keeps a
+        // persistent error from flooding it
+        if(mIsServer)
         {
-            servout << "Failed with status " << returnCode << std::endl;
-            servout << "\tPacket size was " << packet.getDataSize() << std::endl;
-            servout << "\t" << std::strerror(errno) << std::endl;
+            servlog(Warn, "receive") << "Failed with status " << returnCode
+                << ": " << std::strerror(errno) << std::endl;
         }
         else
         {
-            clntout << "Failed with status " << returnCode << std::endl;
-            clntout << "\tPacket size was " << packet.getDataSize() << std::endl;
-            clntout << "\t" << std::strerror(errno) << std::endl;
+            clntlog(Warn, "receive") << "Failed with status " << returnCode
+                << ": " << std::strerror(errno) << std::endl;
         }
-        sf::sleep(sf::seconds(0.1f));
+        return false;
+    }
+    if(mCapture) mCapture->write(packet, sender, port);
+    size_t bytes = packet.getDataSize();
+
+    // Take the acks off the front, and drop anything we've already
+    // handled because our ack went missing
+    bool duplicate = false;
+    sf::Uint16 sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(mConnectionsMutex);
+        sf::Uint64 key = addressKey(sender, port);
+        auto it = mConnections.find(key);
+        if(it == mConnections.end())
+        {
+            // The type follows the header, so it can be looked at
+            // without unwrapping anything
+            sf::Uint16 t = Event::Nop;
+            if(bytes >= Connection::headerSize + 2)
+            {
+                const unsigned char* data = static_cast<const unsigned char*>(packet.getData());
+                t = (data[Connection::headerSize] << 8) | data[Connection::headerSize + 1];
+            }
+            if(t >= Event::Count || !opensConnection(static_cast<Event::EventType>(t)))
+            {
+                mStats.invalid();
+                return false;
+            }
+            // Nothing has been acked yet, so anything turned away here
+            // is sent again by a genuine peer
+            unsigned int strangers = 0;
+            for(const auto& c : mConnections)
+            {
+                if(!c.second.answered()) ++strangers;
+            }
+            if(strangers >= maxStrangers || !mStrangers.allow(0, 0, mClock.getElapsedTime()))
+            {
+                mStats.limited(t);
+                return false;
+            }
+            it = mConnections.insert(std::make_pair(key, Connection())).first;
+        }
+        if(!it->second.unwrap(packet, mClock.getElapsedTime(), duplicate, sequence))
+        {
+            mStats.invalid();
+            return false;
+        }
+    }
+    if(duplicate)
+    {
+        mStats.duplicate();
         return false;
     }
 
@@ -234,17 +520,95 @@ bool NetworkManager::waitEvent()
     // so force them into something we know the size of
     sf::Uint16 t = 0;
     packet >> t;
-    if(t == 0 || t >= static_cast<sf::Uint8>(Event::Count))
+    // Carry on with the whole packet once the last part turns up. Its
+    // datagrams have already been counted as Fragments
+    bool fragmented = t == Event::Fragment;
+    if(fragmented)
+    {
+        mStats.received(t, bytes, sf::Time::Zero);
+        sf::Packet whole;
+        if(!reassemble(packet, addressKey(sender, port), whole)) return false;
+        packet = whole;
+        t = 0;
+        packet >> t;
+        // Nothing unreliable is ever fragmented
+        if(t >= Event::Count || !isReliable(static_cast<Event::EventType>(t)) ||
+            t == Event::Fragment)
+        {
+            mStats.invalid();
+            return false;
+        }
+    }
+    // Nops only carry acks
+    if(t == 0)
+    {
+        mStats.received(t, bytes, sf::Time::Zero);
+        return false;
+    }
+    if(t >= static_cast<sf::Uint8>(Event::Count))
     {
         // Invalid packet
-        if(ld::isServer) servout << "Packet had invalid type" << std::endl;
-        else             clntout << "Packet had invalid type" << std::endl;
+        mStats.invalid();
+        if(mIsServer) servout << "Packet had invalid type" << std::endl;
+        else          clntout << "Packet had invalid type" << std::endl;
         return false;
     }
     auto type = static_cast<Event::EventType>(t);
 
+    // Unreliable events are superseded by the next one of the same
+    // type, so one which arrives after a newer one is out of date. A
+    // late Keepalive says nothing about whether a Move is stale
+    if(!isReliable(type))
+    {
+        std::lock_guard<std::mutex> lock(mConnectionsMutex);
+        auto it = mConnections.find(addressKey(sender, port));
+        if(it != mConnections.end() && !it->second.supersedes(t, sequence))
+        {
+            mStats.dropped(t);
+            return false;
+        }
+    }
+
     // Depending on the type of the packet, we extract different data
+    sf::Clock parseClock;
     Event e;
+    if(!parse(packet, type, e))
+    {
+        mStats.dropped(t);
+        return false;
+    }
+    if(fragmented) mStats.parsed(t, parseClock.getElapsedTime());
+    else           mStats.received(t, bytes, parseClock.getElapsedTime());
+    e.type = type;
+    e.sender = sender;
+    e.senderPort = port;
+
+    // Keep each client to its budget before the game sees anything, so
+    // one client spamming can't eat everyone else's tick. Reliable
+    // events have already been acked, so any turned away are lost for
+    // good, but a client sending gameplay events that fast has no
+    // business expecting them all to count. Joining and leaving only
+    // happen once, and losing them would strand the client
+    if(type != Event::Connect && type != Event::Disconnect &&
+        !admit(e, addressKey(sender, port)))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mEventQueueMutex);
+    mEventQueue.push(e);
+    mStats.queueDepth(mEventQueue.size());
+    return true;
+}
+
+void NetworkManager::wake()
+{
+    mTransport->wake();
+}
+
+bool NetworkManager::parse(sf::Packet& packet, Event::EventType type, Event& e)
+{
+    // Depending on the type of the packet, we extract different data
     switch(type)
     {
         case Event::Nop:
@@ -299,12 +663,14 @@ bool NetworkManager::waitEvent()
             sf::Uint8 charId = 0;
             sf::Vector2f target;
             sf::Vector2f pos;
-            if(!(packet >> gameId >> charId >> target >> pos)) return false;
+            sf::Uint16 sequence = 0;
+            if(!(packet >> gameId >> charId >> target >> pos >> sequence)) return false;
             e.move = {
                 .gameId = gameId,
                 .charId = charId,
                 .target = target,
-                .pos = pos
+                .pos = pos,
+                .sequence = sequence
             };
             break;
         }
@@ -336,9 +702,278 @@ bool NetworkManager::waitEvent()
             };
             break;
         }
+        case Event::Snapshot:
+        {
+            sf::Uint16 gameId = 0;
+            if(!(packet >> gameId)) return false;
+            e.delta = std::make_shared<::Snapshot>();
+            if(!e.delta->read(packet)) return false;
+            e.snapshot = {
+                .gameId = gameId
+            };
+            break;
+        }
+        case Event::SnapshotAck:
+        {
+            sf::Uint16 gameId = 0;
+            sf::Uint8 charId = 0;
+            sf::Uint32 sequence = 0;
+            if(!(packet >> gameId >> charId >> sequence)) return false;
+            e.snapshotAck = {
+                .gameId = gameId,
+                .charId = charId,
+                .sequence = sequence
+            };
+            break;
+        }
+        case Event::Keepalive:
+        {
+            sf::Uint16 gameId = 0;
+            sf::Uint8 charId = 0;
+            if(!(packet >> gameId >> charId)) return false;
+            e.keepalive = {
+                .gameId = gameId,
+                .charId = charId
+            };
+            break;
+        }
+        case Event::JoinState:
+        {
+            sf::Uint16 gameId = 0;
+            if(!(packet >> gameId)) return false;
+            e.state = std::make_shared<::JoinState>();
+            if(!e.state->read(packet)) return false;
+            e.joinState = {
+                .gameId = gameId
+            };
+            break;
+        }
+        case Event::ShardReport:
+        {
+            sf::Uint16 port = 0;
+            sf::Uint16 games = 0;
+            sf::Uint16 players = 0;
+            float load = 0.0f;
+            if(!(packet >> port >> games >> players >> load)) return false;
+            e.shardReport = {
+                .port = port,
+                .games = games,
+                .players = players,
+                .load = load
+            };
+            break;
+        }
+        case Event::Redirect:
+        {
+            sf::Uint16 gameId = 0;
+            sf::Uint32 ip = 0;
+            sf::Uint16 port = 0;
+            if(!(packet >> gameId >> ip >> port)) return false;
+            e.redirect = {
+                .gameId = gameId,
+                .ip = sf::IpAddress(ip),
+                .port = port
+            };
+            break;
+        }
+        case Event::Spectate:
+        {
+            sf::Uint32 ip = 0;
+            sf::Uint16 port = 0;
+            sf::Uint16 gameId = 0;
+            sf::Uint8 viewerId = 0;
+            bool leave = false;
+            if(!(packet >> ip >> port >> gameId >> viewerId >> leave)) return false;
+            e.spectate = {
+                .ip = sf::IpAddress(ip),
+                .port = port,
+                .gameId = gameId,
+                .viewerId = viewerId,
+                .leave = leave
+            };
+            break;
+        }
         default: return false;
     }
-    e.type = type;
-    mEventQueue.push(e);
     return true;
 }
+
+bool NetworkManager::admit(const Event& e, sf::Uint64 sender)
+{
+    std::lock_guard<std::mutex> lock(mLimiterMutex);
+    if(mLimiter.empty()) return true;
+    if(mLimiter.allow(sender, e.type, mClock.getElapsedTime()))
+    {
+        // Any Move still waiting is older than this one
+        if(e.type == Event::Move) mDeferredMoves.erase(sender);
+        return true;
+    }
+    mStats.limited(e.type);
+    if(e.type == Event::Move)
+    {
+        // Only where the client last asked to go matters, so one Move
+        // is as good as many
+        auto it = mDeferredMoves.find(sender);
+        if(it != mDeferredMoves.end())
+        {
+            mStats.coalesced(e.type);
+            it->second = e;
+        }
+        else
+        {
+            mDeferredMoves.insert(std::make_pair(sender, e));
+        }
+    }
+    return false;
+}
+
+bool NetworkManager::isReliable(Event::EventType type)
+{
+    switch(type)
+    {
+        case Event::Connect:
+        case Event::Disconnect:
+        case Event::GameFull:
+        case Event::Damage:
+        case Event::AutoAttack:
+        case Event::JoinState:
+        case Event::Fragment:
+        case Event::Redirect:
+        case Event::Spectate:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool NetworkManager::opensConnection(Event::EventType type)
+{
+    switch(type)
+    {
+        case Event::Connect:
+        case Event::Disconnect:
+        case Event::ShardReport:
+        case Event::Spectate:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void NetworkManager::update()
+{
+    struct Outgoing
+    {
+        sf::IpAddress ip;
+        unsigned short port;
+        sf::Packet packet;
+    };
+    std::vector<Outgoing> outgoing;
+    std::vector<std::pair<sf::IpAddress, unsigned short>> idle;
+    {
+        std::lock_guard<std::mutex> lock(mConnectionsMutex);
+        sf::Time now = mClock.getElapsedTime();
+        // The rest of a packet stops being resent eventually
+        for(auto it = mFragments.begin(); it != mFragments.end();)
+        {
+            if(now - it->second.started > sf::seconds(reassemblyTimeout))
+            {
+                it = mFragments.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        for(auto& c : mConnections)
+        {
+            sf::IpAddress ip(static_cast<sf::Uint32>(c.first >> 16));
+            unsigned short port = static_cast<unsigned short>(c.first & 0xffff);
+            Connection& connection = c.second;
+
+            // Whoever this was has gone, or never really arrived
+            unsigned int timeout = connection.answered() ? idleTimeout : strangerTimeout;
+            if(now - connection.lastActive() > sf::seconds(timeout) &&
+                connection.pending() == 0)
+            {
+                idle.push_back(std::make_pair(ip, port));
+                continue;
+            }
+
+            sf::Uint64 dropped = connection.dropped();
+            for(auto& packet : connection.resends(now))
+            {
+                mStats.resent(packet.getDataSize());
+                outgoing.push_back((Outgoing){ ip, port, packet });
+            }
+            if(connection.dropped() != dropped)
+            {
+                mStats.gaveUp(connection.dropped() - dropped);
+                std::string msg = "Gave up resending to " + ip.toString()
+                    + " on port " + std::to_string(port);
+                if(mIsServer) servout << msg << std::endl;
+                else          clntout << msg << std::endl;
+            }
+
+            // Nothing else is going their way, so send the acks alone
+            if(connection.needsAck())
+            {
+                sf::Packet nop;
+                nop << static_cast<sf::Uint16>(Event::Nop);
+                outgoing.push_back((Outgoing){ ip, port, connection.wrap(nop, false, now) });
+                mStats.sent(Event::Nop, outgoing.back().packet.getDataSize(), sf::Time::Zero);
+            }
+        }
+    }
+    for(auto& o : outgoing) mTransport->send(o.packet, o.ip, o.port);
+    for(auto& i : idle) forget(i.first, i.second);
+
+    // Let held back Moves through once their senders can afford them
+    {
+        std::lock_guard<std::mutex> lock(mLimiterMutex);
+        sf::Time now = mClock.getElapsedTime();
+        for(auto it = mDeferredMoves.begin(); it != mDeferredMoves.end();)
+        {
+            if(!mLimiter.allow(it->first, Event::Move, now))
+            {
+                ++it;
+                continue;
+            }
+            std::lock_guard<std::mutex> queueLock(mEventQueueMutex);
+            mEventQueue.push(it->second);
+            mStats.queueDepth(mEventQueue.size());
+            it = mDeferredMoves.erase(it);
+        }
+    }
+
+    if(mStatsFile.is_open() && mClock.getElapsedTime() >= mNextStatsDump)
+    {
+        mNextStatsDump = mClock.getElapsedTime() + mStatsInterval;
+        NetworkStats::writeJson(mStatsFile, mClock.getElapsedTime().asSeconds(),
+            mStats.totals(), getPeers(), typeNames, Event::Count);
+        mStatsFile.flush();
+    }
+}
+
+float NetworkManager::getRtt(const sf::IpAddress& remoteAddress,
+    unsigned short remotePort)
+{
+    std::lock_guard<std::mutex> lock(mConnectionsMutex);
+    auto it = mConnections.find(addressKey(remoteAddress, remotePort));
+    return it == mConnections.end() ? 0.0f : it->second.rtt();
+}
+
+void NetworkManager::forget(const sf::IpAddress& remoteAddress,
+    unsigned short remotePort)
+{
+    sf::Uint64 key = addressKey(remoteAddress, remotePort);
+    {
+        std::lock_guard<std::mutex> lock(mConnectionsMutex);
+        mConnections.erase(key);
+        mFragments.erase(mFragments.lower_bound(FragmentKey(key, 0)),
+            mFragments.upper_bound(FragmentKey(key, 0xffff)));
+    }
+    std::lock_guard<std::mutex> lock(mLimiterMutex);
+    mLimiter.forget(key);
+    mDeferredMoves.erase(key);
+}
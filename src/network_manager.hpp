@@ -11,12 +11,21 @@
 #include <iostream>
 #include <cerrno>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <vector>
 
 #include "game_container.hpp"
+#include "connection.hpp"
+#include "transport.hpp"
+#include "packet_capture.hpp"
+#include "network_stats.hpp"
+#include "rate_limiter.hpp"
+#include "logger.hpp"
 
-// Should probably just define a new stream?
-#define servout (std::cout << "[SERVER] ")
-#define clntout (std::cout << "[CLIENT] ")
+class Snapshot;
+class JoinState;
 
 class NetworkManager
 {
@@ -24,12 +33,25 @@ private:
 
     unsigned short mPort;
     sf::IpAddress mIp;
-    sf::UdpSocket mSocket;
+    std::unique_ptr<Transport> mTransport;
 
     // The server the client is connected to. Ignored on a server
     unsigned short mRemotePort;
     sf::IpAddress mRemoteIp;
 
+    // Which end we are. Decides the log prefix, and servers can't
+    // connect to servers
+    bool mIsServer;
+
+    // Every datagram received is recorded here, if set
+    std::unique_ptr<CaptureWriter> mCapture;
+
+    NetworkStats mStats;
+    // Stats are appended here every mStatsInterval, if it's open
+    std::ofstream mStatsFile;
+    sf::Time mStatsInterval;
+    sf::Time mNextStatsDump;
+
 public:
 
     // Use similar structure to sf::Event
@@ -63,6 +85,9 @@ public:
             sf::Uint8 charId;
             sf::Vector2f target;
             sf::Vector2f pos;
+            // Numbers the client's orders, so the server's corrections
+            // can say which order they apply to
+            sf::Uint16 sequence;
         };
         struct DamageEvent
         {
@@ -77,6 +102,46 @@ public:
             sf::Uint8 targetId;
             bool cancel; // Attacks can be cancelled mid-animation
         };
+        struct SnapshotEvent
+        {
+            sf::Uint16 gameId; // Characters are carried in delta
+        };
+        struct SnapshotAckEvent
+        {
+            sf::Uint16 gameId;
+            sf::Uint8 charId;
+            sf::Uint32 sequence; // Newest snapshot the client has applied
+        };
+        struct KeepaliveEvent
+        {
+            sf::Uint16 gameId;
+            sf::Uint8 charId;
+        };
+        struct JoinStateEvent
+        {
+            sf::Uint16 gameId; // Everything else is carried in state
+        };
+        struct ShardReportEvent
+        {
+            sf::Uint16 port; // Where the shard takes connections
+            sf::Uint16 games;
+            sf::Uint16 players;
+            float load; // Fraction of the time the shard was busy
+        };
+        struct RedirectEvent
+        {
+            sf::Uint16 gameId;
+            sf::IpAddress ip; // 0.0.0.0 means the lobby's own address
+            sf::Uint16 port;
+        };
+        struct SpectateEvent
+        {
+            sf::IpAddress ip;
+            sf::Uint16 port;
+            sf::Uint16 gameId; // Game to watch
+            sf::Uint8 viewerId; // Allocated by the relay
+            bool leave; // Stop watching instead
+        };
 
         enum EventType {
             Nop,        // No request
@@ -86,6 +151,14 @@ public:
             Move,       // Creature is moving
             Damage,     // Creature has taken damage (or healed)
             AutoAttack, // Creature is attacking (or cancelling)
+            Snapshot,   // Periodic delta compressed state of a game
+            SnapshotAck,// Client has received a snapshot
+            Keepalive,  // Client is still there
+            JoinState,  // Whole state of a game, for a client joining it
+            Fragment,   // Part of a packet too big for one datagram
+            ShardReport,// Shard telling the lobby how busy it is
+            Redirect,   // Lobby telling a client which shard to use
+            Spectate,   // Start or stop watching a game without playing
             Count
         };
         EventType type;
@@ -98,23 +171,149 @@ public:
             MoveEvent           move;
             DamageEvent         damage;
             AutoAttackEvent     autoAttack;
+            SnapshotEvent       snapshot;
+            SnapshotAckEvent    snapshotAck;
+            KeepaliveEvent      keepalive;
+            JoinStateEvent      joinState;
+            ShardReportEvent    shardReport;
+            RedirectEvent       redirect;
+            SpectateEvent       spectate;
         };
 
-        Event() {}
+        // Variable length payload of Snapshot events, which can't
+        // live in the union
+        std::shared_ptr<::Snapshot> delta;
+        // Payload of JoinState events
+        std::shared_ptr<::JoinState> state;
+
+        // Where a received event actually came from, whatever its
+        // payload claims. Unset on events which weren't received
+        sf::IpAddress sender;
+        sf::Uint16 senderPort;
+
+        Event() : senderPort(0) {}
     };
 
+    // Name of each event type, for logs and stats
+    static const char* const typeNames[];
+
+    // Largest packet body sent in one datagram, leaving room for
+    // headers under a typical MTU. Anything bigger is fragmented
+    static const size_t maxDatagramBody = 1200;
+
+    // Seconds without sending or receiving anything after which
+    // everything kept about an address is forgotten
+    static const unsigned int idleTimeout = 30;
+    // Anyone can open a connection by sending a Connect, even with a
+    // made up address. Until we answer, it's forgotten after only
+    // strangerTimeout seconds idle, and only maxStrangers are kept
+    static const unsigned int strangerTimeout = 5;
+    static const unsigned int maxStrangers = 256;
+
 private:
 
+    // Filled by the network thread and emptied by the main thread
     std::queue<Event> mEventQueue;
+    std::mutex mEventQueueMutex;
+
+    // Packets arriving in fragments, put back together as the
+    // fragments come in. Fragments of several packets can be in flight
+    // at once, so each is kept by sender and fragmented packet id
+    struct Reassembly
+    {
+        std::vector<std::string> parts;
+        unsigned int received;
+        sf::Time started;
+    };
+    typedef std::pair<sf::Uint64, sf::Uint16> FragmentKey;
+    // Most packets one sender may have part way through at once, and
+    // seconds after which one is given up on
+    static const unsigned int maxReassemblies = 4;
+    static const unsigned int reassemblyTimeout = 10;
+
+    // Acks and resends for everyone we've exchanged packets with,
+    // shared by the network thread and the main thread. Partly
+    // received packets are kept with them
+    std::map<sf::Uint64, Connection> mConnections;
+    std::map<FragmentKey, Reassembly> mFragments;
+    sf::Uint16 mNextFragmented;
+    // How fast strangers may open connections, all of them together
+    RateLimiter mStrangers;
+    std::mutex mConnectionsMutex;
+    sf::Clock mClock;
+
+    // Budgets for what each sender may send us. Moves over budget wait
+    // here, latest first, until their sender has a token again
+    RateLimiter mLimiter;
+    std::map<sf::Uint64, Event> mDeferredMoves;
+    std::mutex mLimiterMutex;
+
+    static sf::Uint64 addressKey(const sf::IpAddress& ip, unsigned short port)
+    {
+        return (sf::Uint64(ip.toInteger()) << 16) | port;
+    }
+
+    // Events which must arrive. Everything else is sent often enough
+    // that the next one will do instead of a resend
+    static bool isReliable(Event::EventType type);
+    // Events a peer introduces (or takes away) itself with. Anything
+    // else from an address we have no connection with is dropped
+    // before any state is kept for it
+    static bool opensConnection(Event::EventType type);
+
+    // Read the body of a packet of the given type into e
+    bool parse(sf::Packet& packet, Event::EventType type, Event& e);
+
+    // Send a packet too big for one datagram as several Fragments.
+    // Only reliable events are sent this way, since losing any
+    // fragment would lose the lot
+    sf::Socket::Status sendFragmented(const sf::Packet& packet,
+        const sf::IpAddress& remoteAddress, unsigned short remotePort);
+    // Add a fragment to the packet it's part of. Returns true and
+    // fills packet once every part of it has arrived
+    bool reassemble(sf::Packet& fragment, sf::Uint64 sender, sf::Packet& packet);
+
+    // True if the sender is within budget for this event. If not, it
+    // is thrown away, unless it's a Move, which is held back
+    bool admit(const Event& e, sf::Uint64 sender);
 
 public:
 
-    NetworkManager(const JsonBox::Value& v);
-    NetworkManager();
+    // Bind UDP sockets to the port given in the config, as many as
+    // sockets says, and start capturing to the file given as capture,
+    // if there is one
+    NetworkManager(const JsonBox::Value& v, bool isServer);
+    // Use some other transport, such as a LoopbackTransport
+    NetworkManager(std::unique_ptr<Transport> transport, bool isServer);
     ~NetworkManager();
 
     unsigned short getPort() const;
+
+    // Record every datagram received to a capture file, for replaying
+    // later. Must be called before waitEvent is
+    void startCapture(const std::string& path);
+
+    // Append the stats to a file as a line of JSON every interval
+    // seconds, whenever update is called. Must be called before update is
+    void startStatsDump(const std::string& path, float interval);
+
+    // Limit how fast each sender's events are let through, as read by
+    // RateLimiter::load. Everything but Connect and Disconnect is
+    // limited, reliable events included, though those have been acked
+    // by the time they're checked so any turned away are lost. Opening
+    // connections is limited separately, whatever this says
+    void setRateLimits(const JsonBox::Value& v);
+
+    // Counts of everything sent and received so far
+    NetworkStats::Totals getStats() const { return mStats.totals(); }
+    // Round trip time and loss for everyone we've talked to
+    std::vector<NetworkStats::Peer> getPeers();
     const sf::IpAddress& getIp() const;
+    // The address the host at remoteAddress can reach us on
+    sf::IpAddress getAddressFor(const sf::IpAddress& remoteAddress) const
+    {
+        return mTransport->getAddressFor(remoteAddress);
+    }
 
     // Connect to a server. Does nothing on a client
     bool connectToServer(const sf::IpAddress &remoteAddress,
@@ -139,8 +338,32 @@ public:
     // was a valid event, add it to the event queue and return true
     bool waitEvent();
 
+    // Make a waitEvent blocked in another thread return now, so the
+    // thread can notice it has been told to stop
+    void wake();
+
+    // Resend reliable events which haven't been acked, and ack
+    // anything received since we last sent to its sender. Should be
+    // called regularly by whichever thread sends
+    void update();
+
+    // Smoothed round trip time to an address, in seconds
+    float getRtt(const sf::IpAddress& remoteAddress, unsigned short remotePort);
+
+    // Stop tracking acks for an address which has gone away
+    void forget(const sf::IpAddress& remoteAddress, unsigned short remotePort);
+
 };
 
+// Get the key for connected clients from a client charId and gameId
+// These are used in NetEvents to uniquely identify each client so as
+// to not broadcast ip and port to other clients. It also allows
+// multiple connections from the same ip
+inline sf::Uint32 clientKey(const sf::Uint16 gameId, const sf::Uint8 charId)
+{
+    return sf::Uint32(gameId << 8) + sf::Uint32(charId);
+}
+
 // Overload packet operators for common structures
 template<typename T>
 sf::Packet& operator<<(sf::Packet& packet, const sf::Vector2<T>& v)
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include <SFML/System.hpp>
+
+#include "network_overlay.hpp"
+
+namespace
+{
+const float left = 8.0f;
+const float top = 8.0f;
+const float width = 200.0f;
+const float rowHeight = 4.0f;
+// Bars are full at 100KB/s
+const float maxBytesPerSecond = 100000.0f;
+const float maxRtt = 0.5f;
+}
+
+NetworkOverlay::NetworkOverlay() :
+    mHaveLast(false),
+    mSinceLast(0.0f)
+{
+}
+
+void NetworkOverlay::bar(unsigned int row, float fill, const sf::Color& color)
+{
+    fill = std::min(std::max(fill, 0.0f), 1.0f);
+    sf::RectangleShape shape(sf::Vector2f(std::max(1.0f, fill * width), rowHeight - 1.0f));
+    shape.setPosition(left, top + row * rowHeight);
+    shape.setFillColor(color);
+    mShapes.push_back(shape);
+}
+
+void NetworkOverlay::update(float dt, const NetworkStats::Totals& totals,
+    const std::vector<NetworkStats::Peer>& peers, unsigned int types)
+{
+    mSinceLast += dt;
+    if(mHaveLast && mSinceLast < 0.5f) return;
+
+    types = std::min(types, NetworkStats::maxTypes);
+    mShapes.clear();
+
+    // Backing, so the bars show up over the map
+    unsigned int rows = types * 2 + 3;
+    sf::RectangleShape back(sf::Vector2f(width + 8.0f, rows * rowHeight + 8.0f));
+    back.setPosition(left - 4.0f, top - 4.0f);
+    back.setFillColor(sf::Color(0, 0, 0, 160));
+    mShapes.push_back(back);
+
+    auto scale = [](float bytesPerSecond) {
+        return std::log(1.0f + bytesPerSecond) / std::log(1.0f + maxBytesPerSecond);
+    };
+    for(unsigned int i = 0; i < types; ++i)
+    {
+        float in = 0.0f;
+        float out = 0.0f;
+        if(mHaveLast && mSinceLast > 0.0f)
+        {
+            in = (totals.types[i].bytesIn - mLast.types[i].bytesIn) / mSinceLast;
+            out = (totals.types[i].bytesOut - mLast.types[i].bytesOut) / mSinceLast;
+        }
+        bar(i * 2, scale(in), sf::Color(0, 200, 0));
+        bar(i * 2 + 1, scale(out), sf::Color(0, 100, 255));
+    }
+    // The client only talks to the server, so there's only one peer
+    if(!peers.empty())
+    {
+        bar(types * 2 + 1, peers[0].rtt / maxRtt, sf::Color(255, 220, 0));
+        bar(types * 2 + 2, peers[0].loss, sf::Color(220, 0, 0));
+    }
+
+    mLast = totals;
+    mHaveLast = true;
+    mSinceLast = 0.0f;
+}
+
+void NetworkOverlay::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    for(const auto& shape : mShapes) target.draw(shape, states);
+}
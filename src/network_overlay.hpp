@@ -0,0 +1,39 @@
+#ifndef NETWORK_OVERLAY_HPP
+#define NETWORK_OVERLAY_HPP
+
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include <SFML/System.hpp>
+
+#include "network_stats.hpp"
+
+// On screen graph of the NetworkManager's stats, for the client. There
+// is no font to label things with, so it's bars only: one row per
+// event type in EventType order, with bytes received per second in
+// green above bytes sent per second in blue, on a log scale. Below
+// them are the round trip time to the server in yellow, out of half a
+// second, and packet loss in red
+class NetworkOverlay : public sf::Drawable
+{
+private:
+
+    NetworkStats::Totals mLast;
+    bool mHaveLast;
+    float mSinceLast;
+    std::vector<sf::RectangleShape> mShapes;
+
+    void bar(unsigned int row, float fill, const sf::Color& color);
+
+public:
+
+    NetworkOverlay();
+
+    // Rates are averaged over half a second, so the bars are readable
+    void update(float dt, const NetworkStats::Totals& totals,
+        const std::vector<NetworkStats::Peer>& peers, unsigned int types);
+
+    // Draws in screen coordinates, so set the default view first
+    void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+};
+
+#endif /* NETWORK_OVERLAY_HPP */
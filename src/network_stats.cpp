@@ -0,0 +1,150 @@
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+
+#include "network_stats.hpp"
+
+NetworkStats::NetworkStats() :
+    mInvalid(0),
+    mDuplicates(0),
+    mResends(0),
+    mResendBytes(0),
+    mGivenUp(0),
+    mQueueDepth(0),
+    mMaxQueueDepth(0)
+{
+    for(auto& c : mTypes)
+    {
+        c.packetsIn = 0;
+        c.packetsOut = 0;
+        c.bytesIn = 0;
+        c.bytesOut = 0;
+        c.parseMicros = 0;
+        c.serializeMicros = 0;
+        c.drops = 0;
+        c.limited = 0;
+        c.coalesced = 0;
+    }
+}
+
+void NetworkStats::received(unsigned int type, size_t bytes, sf::Time parse)
+{
+    if(type >= maxTypes) return;
+    AtomicCounters& c = mTypes[type];
+    ++c.packetsIn;
+    c.bytesIn += bytes;
+    c.parseMicros += parse.asMicroseconds();
+}
+
+void NetworkStats::sent(unsigned int type, size_t bytes, sf::Time serialize)
+{
+    if(type >= maxTypes) return;
+    AtomicCounters& c = mTypes[type];
+    ++c.packetsOut;
+    c.bytesOut += bytes;
+    c.serializeMicros += serialize.asMicroseconds();
+}
+
+void NetworkStats::parsed(unsigned int type, sf::Time parse)
+{
+    if(type >= maxTypes) return;
+    mTypes[type].parseMicros += parse.asMicroseconds();
+}
+
+void NetworkStats::serialized(unsigned int type, sf::Time serialize)
+{
+    if(type >= maxTypes) return;
+    mTypes[type].serializeMicros += serialize.asMicroseconds();
+}
+
+void NetworkStats::dropped(unsigned int type)
+{
+    if(type >= maxTypes) return;
+    ++mTypes[type].drops;
+}
+
+void NetworkStats::limited(unsigned int type)
+{
+    if(type >= maxTypes) return;
+    ++mTypes[type].limited;
+}
+
+void NetworkStats::coalesced(unsigned int type)
+{
+    if(type >= maxTypes) return;
+    ++mTypes[type].coalesced;
+}
+
+void NetworkStats::queueDepth(size_t depth)
+{
+    mQueueDepth = depth;
+    sf::Uint64 max = mMaxQueueDepth;
+    while(depth > max && !mMaxQueueDepth.compare_exchange_weak(max, depth));
+}
+
+NetworkStats::Totals NetworkStats::totals() const
+{
+    Totals t;
+    for(unsigned int i = 0; i < maxTypes; ++i)
+    {
+        const AtomicCounters& c = mTypes[i];
+        t.types[i] = (Counters){
+            c.packetsIn, c.packetsOut,
+            c.bytesIn, c.bytesOut,
+            c.parseMicros, c.serializeMicros,
+            c.drops,
+            c.limited, c.coalesced
+        };
+    }
+    t.invalid = mInvalid;
+    t.duplicates = mDuplicates;
+    t.resends = mResends;
+    t.resendBytes = mResendBytes;
+    t.givenUp = mGivenUp;
+    t.queueDepth = mQueueDepth;
+    t.maxQueueDepth = mMaxQueueDepth;
+    return t;
+}
+
+void NetworkStats::writeJson(std::ostream& out, float time, const Totals& totals,
+    const std::vector<Peer>& peers, const char* const* names,
+    unsigned int types)
+{
+    out << "{\"time\":" << time << ",\"types\":{";
+    for(unsigned int i = 0; i < types && i < maxTypes; ++i)
+    {
+        const Counters& c = totals.types[i];
+        if(i > 0) out << ",";
+        out << "\"" << names[i] << "\":{"
+            << "\"packetsIn\":" << c.packetsIn
+            << ",\"packetsOut\":" << c.packetsOut
+            << ",\"bytesIn\":" << c.bytesIn
+            << ",\"bytesOut\":" << c.bytesOut
+            << ",\"parseMicros\":" << c.parseMicros
+            << ",\"serializeMicros\":" << c.serializeMicros
+            << ",\"drops\":" << c.drops
+            << ",\"limited\":" << c.limited
+            << ",\"coalesced\":" << c.coalesced << "}";
+    }
+    out << "},\"invalid\":" << totals.invalid
+        << ",\"duplicates\":" << totals.duplicates
+        << ",\"resends\":" << totals.resends
+        << ",\"resendBytes\":" << totals.resendBytes
+        << ",\"givenUp\":" << totals.givenUp
+        << ",\"queueDepth\":" << totals.queueDepth
+        << ",\"maxQueueDepth\":" << totals.maxQueueDepth
+        << ",\"peers\":[";
+    for(size_t i = 0; i < peers.size(); ++i)
+    {
+        const Peer& p = peers[i];
+        if(i > 0) out << ",";
+        out << "{\"address\":\"" << p.address << "\""
+            << ",\"rtt\":" << p.rtt
+            << ",\"loss\":" << p.loss
+            << ",\"lost\":" << p.lost
+            << ",\"pending\":" << p.pending << "}";
+    }
+    out << "]}" << "\n";
+}
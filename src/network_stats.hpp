@@ -0,0 +1,115 @@
+#ifndef NETWORK_STATS_HPP
+#define NETWORK_STATS_HPP
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+
+// Counters kept by a NetworkManager, per event type where the type is
+// known. Updated from both the network thread and whichever threads
+// send, so every counter is atomic. Read them through a Totals, which
+// is a plain copy
+class NetworkStats
+{
+public:
+
+    // Enough for every NetworkManager::Event::EventType
+    static const unsigned int maxTypes = 16;
+
+    // Packets and bytes are counted as they went over the wire. An
+    // event too big for one datagram is counted as the Fragments it
+    // went in, and only the time spent on it is counted as its type
+    struct Counters
+    {
+        sf::Uint64 packetsIn;
+        sf::Uint64 packetsOut;
+        sf::Uint64 bytesIn;
+        sf::Uint64 bytesOut;
+        sf::Uint64 parseMicros;
+        sf::Uint64 serializeMicros;
+        // Received but thrown away, because they were malformed or
+        // had already been superseded
+        sf::Uint64 drops;
+        // Over their sender's budget. Limited Moves are held back, and
+        // coalesced counts those replaced by a newer one while waiting
+        sf::Uint64 limited;
+        sf::Uint64 coalesced;
+    };
+
+    struct Totals
+    {
+        Counters types[maxTypes];
+        // Packets which couldn't be attributed to a type
+        sf::Uint64 invalid;
+        sf::Uint64 duplicates;
+        sf::Uint64 resends;
+        sf::Uint64 resendBytes;
+        sf::Uint64 givenUp;
+        sf::Uint64 queueDepth;
+        sf::Uint64 maxQueueDepth;
+    };
+
+    // Per address, from the reliability layer
+    struct Peer
+    {
+        std::string address;
+        float rtt;
+        float loss;
+        sf::Uint64 lost;
+        size_t pending;
+    };
+
+private:
+
+    struct AtomicCounters
+    {
+        std::atomic<sf::Uint64> packetsIn;
+        std::atomic<sf::Uint64> packetsOut;
+        std::atomic<sf::Uint64> bytesIn;
+        std::atomic<sf::Uint64> bytesOut;
+        std::atomic<sf::Uint64> parseMicros;
+        std::atomic<sf::Uint64> serializeMicros;
+        std::atomic<sf::Uint64> drops;
+        std::atomic<sf::Uint64> limited;
+        std::atomic<sf::Uint64> coalesced;
+    };
+
+    AtomicCounters mTypes[maxTypes];
+    std::atomic<sf::Uint64> mInvalid;
+    std::atomic<sf::Uint64> mDuplicates;
+    std::atomic<sf::Uint64> mResends;
+    std::atomic<sf::Uint64> mResendBytes;
+    std::atomic<sf::Uint64> mGivenUp;
+    std::atomic<sf::Uint64> mQueueDepth;
+    std::atomic<sf::Uint64> mMaxQueueDepth;
+
+public:
+
+    NetworkStats();
+
+    void received(unsigned int type, size_t bytes, sf::Time parse);
+    void sent(unsigned int type, size_t bytes, sf::Time serialize);
+    // Time spent on events which went in Fragments
+    void parsed(unsigned int type, sf::Time parse);
+    void serialized(unsigned int type, sf::Time serialize);
+    void dropped(unsigned int type);
+    void limited(unsigned int type);
+    void coalesced(unsigned int type);
+    void invalid() { ++mInvalid; }
+    void duplicate() { ++mDuplicates; }
+    void resent(size_t bytes) { ++mResends; mResendBytes += bytes; }
+    void gaveUp(sf::Uint64 packets) { mGivenUp += packets; }
+    void queueDepth(size_t depth);
+
+    Totals totals() const;
+
+    // Write one line of JSON holding the totals, the peers, and the
+    // time in seconds they were taken at. names gives each type's name
+    static void writeJson(std::ostream& out, float time, const Totals& totals,
+        const std::vector<Peer>& peers, const char* const* names,
+        unsigned int types);
+};
+
+#endif /* NETWORK_STATS_HPP */
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "packet_capture.hpp"
+
+namespace
+{
+const char magic[4] = { 'L', 'D', 'C', 'P' };
+const sf::Uint8 version = 2;
+
+template<typename T>
+void put(std::ostream& out, T v)
+{
+    for(unsigned int i = 0; i < sizeof(T); ++i)
+    {
+        out.put(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+template<typename T>
+bool get(std::istream& in, T& v)
+{
+    v = 0;
+    for(unsigned int i = 0; i < sizeof(T); ++i)
+    {
+        int c = in.get();
+        if(c == EOF) return false;
+        v |= static_cast<T>(static_cast<unsigned char>(c)) << (8 * i);
+    }
+    return true;
+}
+}
+
+CaptureWriter::CaptureWriter(const std::string& path) :
+    mFile(path, std::ios::binary | std::ios::trunc)
+{
+    if(!mFile) throw std::runtime_error("Failed to open capture file " + path);
+    mFile.write(magic, sizeof(magic));
+    put(mFile, version);
+}
+
+void CaptureWriter::write(const sf::Packet& packet, const sf::IpAddress& ip,
+    unsigned short port)
+{
+    put(mFile, static_cast<sf::Uint64>(mClock.getElapsedTime().asMicroseconds()));
+    put(mFile, static_cast<sf::Uint32>(ip.toInteger()));
+    put(mFile, static_cast<sf::Uint16>(port));
+    put(mFile, static_cast<sf::Uint32>(packet.getDataSize()));
+    mFile.write(static_cast<const char*>(packet.getData()), packet.getDataSize());
+}
+
+CaptureReader::CaptureReader(const std::string& path) :
+    mFile(path, std::ios::binary)
+{
+    if(!mFile) throw std::runtime_error("Failed to open capture file " + path);
+    char m[sizeof(magic)];
+    sf::Uint8 v = 0;
+    if(!mFile.read(m, sizeof(m)) || !std::equal(m, m + sizeof(m), magic) ||
+        !get(mFile, v) || v != version)
+    {
+        throw std::runtime_error(path + " is not a capture file");
+    }
+}
+
+bool CaptureReader::next(CaptureRecord& record)
+{
+    sf::Uint64 time = 0;
+    sf::Uint32 ip = 0;
+    sf::Uint16 port = 0;
+    sf::Uint32 size = 0;
+    if(!get(mFile, time) || !get(mFile, ip) || !get(mFile, port) || !get(mFile, size))
+    {
+        return false;
+    }
+    record.time = time;
+    record.ip = sf::IpAddress(ip);
+    record.port = port;
+    record.data.resize(size);
+    // A truncated last record is dropped
+    return size == 0 || mFile.read(&record.data[0], size);
+}
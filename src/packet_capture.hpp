@@ -0,0 +1,57 @@
+#ifndef PACKET_CAPTURE_HPP
+#define PACKET_CAPTURE_HPP
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+// Capture files hold every datagram a NetworkManager received, so a
+// session can be fed back into a server later. The file is a magic
+// number and version, followed by one record per datagram of
+//     [Uint64 microseconds since capture began]
+//     [Uint32 sender ip][Uint16 sender port]
+//     [Uint32 size][size bytes of datagram]
+// with every integer little endian
+
+struct CaptureRecord
+{
+    sf::Uint64 time; // Microseconds
+    sf::IpAddress ip;
+    unsigned short port;
+    std::vector<char> data;
+};
+
+class CaptureWriter
+{
+private:
+
+    std::ofstream mFile;
+    sf::Clock mClock;
+
+public:
+
+    // Throws if the file can't be opened
+    explicit CaptureWriter(const std::string& path);
+
+    void write(const sf::Packet& packet, const sf::IpAddress& ip,
+        unsigned short port);
+};
+
+class CaptureReader
+{
+private:
+
+    std::ifstream mFile;
+
+public:
+
+    // Throws if the file can't be opened or isn't a capture
+    explicit CaptureReader(const std::string& path);
+
+    // Read the next record, returning false at the end of the file
+    bool next(CaptureRecord& record);
+};
+
+#endif /* PACKET_CAPTURE_HPP */
@@ -79,31 +79,37 @@ public:
             });
     }
 
-    void update(float speed)
+    // Where to head for next. Once there are fewer than two nodes left
+    // in the path we should be close enough to move straight to the
+    // actual (and not node) destination
+    sf::Vector2f waypoint() const
     {
-        // If the path is empty or has just one entry it, we
-        // should be close enough to just move straight to the
-        // actual (and not node) destination.
-        if(path.size() < 2)
-        {
-            auto v = target - pos;
-            float norm = vecmath::norm(v);
-            if(norm > 0.01) pos += v / norm * speed;
-        }
-        else
+        if(path.size() < 2) return target;
+        return vecmath::to<float, unsigned int>(path.front());
+    }
+    // How close to the waypoint counts as being there
+    float arriveDistance() const { return path.size() < 2 ? 0.01f : 0.1f; }
+    bool onPath() const { return path.size() >= 2; }
+
+    // If pos is suitably close to the next path node, remove it
+    void reached()
+    {
+        if(path.size() >= 2 && vecmath::norm(pos - waypoint()) < 0.1)
         {
-            // Move in a straight line from the current position to the
-            // first node in the path
-            auto v = vecmath::to<float, unsigned int>(path.front()) - pos;
-            float norm = vecmath::norm(v);
-            if(norm > 0.1) pos += v / norm * speed;
-            // If suitably close to the path node, remove it
-            if(vecmath::norm(pos-vecmath::to<float, unsigned int>(path.front())) < 0.1)
-            {
-                path.pop_front();
-            }
+            path.pop_front();
         }
     }
+
+    // Move in a straight line towards the waypoint. GameContainer
+    // moves its characters itself, in CharacterStore::update, so this
+    // is only used to replay predicted movement
+    void update(float speed)
+    {
+        auto v = waypoint() - pos;
+        float norm = vecmath::norm(v);
+        if(norm > arriveDistance()) pos += v / norm * speed;
+        reached();
+    }
 };
 
 #endif /* PATHFINDING_HELPER_HPP */
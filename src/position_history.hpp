@@ -0,0 +1,71 @@
+#ifndef POSITION_HISTORY_HPP
+#define POSITION_HISTORY_HPP
+
+#include <SFML/System.hpp>
+
+// Where a character has been over the last few ticks, so the server
+// can see the game as a client saw it when they acted. Recording is a
+// single store, and finding a time is a binary search over samples
+// which are always in time order
+class PositionHistory
+{
+private:
+
+    struct Sample
+    {
+        float t;
+        sf::Vector2f pos;
+    };
+
+    // A second's worth at the default tick rate
+    static const unsigned int size = 64;
+    Sample mSamples[size];
+    unsigned int mCount;
+    unsigned int mNext;
+
+    const Sample& at(unsigned int i) const
+    {
+        // 0 is the oldest sample
+        return mSamples[(mNext + size - mCount + i) % size];
+    }
+
+public:
+
+    PositionHistory() : mCount(0), mNext(0) {}
+
+    // Samples must be pushed in time order
+    void push(float t, const sf::Vector2f& pos)
+    {
+        mSamples[mNext] = (Sample){ t, pos };
+        mNext = (mNext + 1) % size;
+        if(mCount < size) ++mCount;
+    }
+
+    bool empty() const { return mCount == 0; }
+    // Earliest time which can be looked up exactly
+    float oldest() const { return mCount == 0 ? 0.0f : at(0).t; }
+
+    // Position at time t, interpolated between the samples either
+    // side. Times outside the history give the nearest end of it
+    sf::Vector2f sample(float t) const
+    {
+        if(mCount == 0) return sf::Vector2f();
+        if(t <= at(0).t) return at(0).pos;
+        if(t >= at(mCount-1).t) return at(mCount-1).pos;
+        // Find the first sample after t
+        unsigned int lo = 1;
+        unsigned int hi = mCount - 1;
+        while(lo < hi)
+        {
+            unsigned int mid = (lo + hi) / 2;
+            if(at(mid).t > t) hi = mid;
+            else lo = mid + 1;
+        }
+        const Sample& a = at(lo-1);
+        const Sample& b = at(lo);
+        float u = b.t > a.t ? (t - a.t) / (b.t - a.t) : 1.0f;
+        return a.pos + (b.pos - a.pos) * u;
+    }
+};
+
+#endif /* POSITION_HISTORY_HPP */
@@ -0,0 +1,39 @@
+#include <algorithm>
+#include <vector>
+#include <SFML/System.hpp>
+
+#include "priority_accumulator.hpp"
+
+std::vector<sf::Uint8> PriorityAccumulator::select(
+    const std::vector<Candidate>& candidates, float dt, float budget,
+    float maxCredit)
+{
+    std::vector<float> priority(mPriority.size(), 0.0f);
+    for(const auto& c : candidates)
+    {
+        priority[c.charId] = mPriority[c.charId] + c.weight * dt;
+    }
+    mPriority.swap(priority);
+    mCredit = std::min(mCredit + budget * dt, maxCredit);
+
+    std::vector<const Candidate*> ranked;
+    for(const auto& c : candidates) ranked.push_back(&c);
+    std::sort(ranked.begin(), ranked.end(), [this](const Candidate* a, const Candidate* b) {
+        return mPriority[a->charId] > mPriority[b->charId];
+    });
+
+    // Lower priority updates which happen to be small still fill in
+    // whatever room the bigger ones leave. One too big for any credit
+    // could never go, so it goes on credit and the debt holds back the
+    // rounds after
+    std::vector<sf::Uint8> selected;
+    for(const Candidate* c : ranked)
+    {
+        if(c->bytes > mCredit && !selected.empty()) continue;
+        if(c->bytes > mCredit && mCredit <= 0.0f) break;
+        selected.push_back(c->charId);
+        mCredit -= c->bytes;
+        mPriority[c->charId] = 0.0f;
+    }
+    return selected;
+}
@@ -0,0 +1,48 @@
+#ifndef PRIORITY_ACCUMULATOR_HPP
+#define PRIORITY_ACCUMULATOR_HPP
+
+#include <vector>
+#include <SFML/System.hpp>
+
+// Decides which character updates go to one client when there isn't
+// room for all of them. Every update waiting to be sent gains priority
+// at a rate given by its weight, so important updates go first but
+// everything gets its turn eventually. Each round the client earns a
+// byte budget, and the highest priority updates which fit are sent and
+// start again from nothing
+class PriorityAccumulator
+{
+public:
+
+    struct Candidate
+    {
+        sf::Uint8 charId;
+        float weight; // Priority gained per second waiting
+        size_t bytes; // Cost of sending it
+    };
+
+private:
+
+    // Priority of each charId's pending update
+    std::vector<float> mPriority;
+    // Bytes the client can still be sent. While there is any credit
+    // the top update goes even if it doesn't fit, so this may go
+    // negative, and then nothing is sent until it's paid back
+    float mCredit;
+
+public:
+
+    PriorityAccumulator() : mPriority(256, 0.0f), mCredit(0.0f) {}
+
+    // Add dt seconds worth of priority to each candidate, and dt
+    // seconds of budget bytes per second to the credit, keeping at
+    // most maxCredit. Returns the charIds of the candidates to send,
+    // highest priority first. Anything not a candidate has nothing
+    // waiting, so its priority is reset
+    std::vector<sf::Uint8> select(const std::vector<Candidate>& candidates,
+        float dt, float budget, float maxCredit);
+
+    float credit() const { return mCredit; }
+};
+
+#endif /* PRIORITY_ACCUMULATOR_HPP */
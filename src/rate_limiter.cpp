@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+
+#include "rate_limiter.hpp"
+
+RateLimiter::RateLimiter(unsigned int types) :
+    mBudgets(types, (Budget){ 0.0f, 0.0f }),
+    mTotal((Budget){ 0.0f, 0.0f })
+{
+}
+
+void RateLimiter::load(const JsonBox::Value& v, const char* const* names)
+{
+    auto read = [](JsonBox::Value& v) {
+        JsonBox::Object o = v.getObject();
+        Budget budget = { 0.0f, 0.0f };
+        if(o.count("rate") > 0) budget.rate = o["rate"].tryGetFloat(0.0f);
+        // Default to a second's worth
+        budget.burst = o.count("burst") > 0 ?
+            o["burst"].tryGetFloat(budget.rate) : budget.rate;
+        return budget;
+    };
+
+    JsonBox::Object o = v.getObject();
+    if(o.count("All") > 0) mTotal = read(o["All"]);
+    for(unsigned int i = 0; i < mBudgets.size(); ++i)
+    {
+        if(o.count(names[i]) > 0) mBudgets[i] = read(o[names[i]]);
+    }
+}
+
+void RateLimiter::setBudget(unsigned int type, Budget budget)
+{
+    if(type < mBudgets.size()) mBudgets[type] = budget;
+}
+
+bool RateLimiter::empty() const
+{
+    if(mTotal.rate > 0.0f) return false;
+    for(const auto& b : mBudgets)
+    {
+        if(b.rate > 0.0f) return false;
+    }
+    return true;
+}
+
+bool RateLimiter::take(Bucket& bucket, const Budget& budget, sf::Time now, bool consume)
+{
+    if(budget.rate <= 0.0f) return true;
+    bucket.tokens = std::min(budget.burst,
+        bucket.tokens + (now - bucket.refilled).asSeconds() * budget.rate);
+    bucket.refilled = now;
+    if(bucket.tokens < 1.0f) return false;
+    if(consume) bucket.tokens -= 1.0f;
+    return true;
+}
+
+bool RateLimiter::allow(sf::Uint64 sender, unsigned int type, sf::Time now)
+{
+    if(type >= mBudgets.size()) return true;
+    auto it = mBuckets.find(sender);
+    if(it == mBuckets.end())
+    {
+        // New senders start with a full burst
+        std::vector<Bucket> buckets;
+        for(const auto& b : mBudgets) buckets.push_back((Bucket){ b.burst, now });
+        buckets.push_back((Bucket){ mTotal.burst, now });
+        it = mBuckets.insert(std::make_pair(sender, buckets)).first;
+    }
+    Bucket& bucket = it->second[type];
+    Bucket& total = it->second.back();
+    // Only spend from either once both have a token, so an event
+    // turned away by one bucket doesn't drain the other
+    if(!take(bucket, mBudgets[type], now, false)) return false;
+    if(!take(total, mTotal, now, true)) return false;
+    take(bucket, mBudgets[type], now, true);
+    return true;
+}
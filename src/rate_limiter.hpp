@@ -0,0 +1,65 @@
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <map>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+
+// Token buckets for each sender, one per event type and one shared by
+// every type. Each event takes a token from its type's bucket and from
+// the shared bucket, and buckets refill at a steady rate up to a burst
+// size, so a client can send in short bursts but not keep it up.
+// Types without a budget are never limited. Not thread safe
+class RateLimiter
+{
+public:
+
+    struct Budget
+    {
+        float rate;  // Tokens added per second
+        float burst; // Most tokens a bucket can hold
+    };
+
+private:
+
+    struct Bucket
+    {
+        float tokens;
+        sf::Time refilled;
+    };
+
+    // Budgets by event type, and for all types together. A rate of 0
+    // means no limit
+    std::vector<Budget> mBudgets;
+    Budget mTotal;
+
+    // Buckets of each sender, by type then the shared one
+    std::map<sf::Uint64, std::vector<Bucket>> mBuckets;
+
+    static bool take(Bucket& bucket, const Budget& budget, sf::Time now, bool consume);
+
+public:
+
+    // types is the number of event types there are
+    explicit RateLimiter(unsigned int types);
+
+    // Read budgets from an object of { "rate", "burst" } objects keyed
+    // by event name, where "All" is the budget shared by every type
+    void load(const JsonBox::Value& v, const char* const* names);
+
+    void setBudget(unsigned int type, Budget budget);
+    void setTotalBudget(Budget budget) { mTotal = budget; }
+
+    // True if nothing is limited
+    bool empty() const;
+
+    // True if the sender has a token to spend on an event of this
+    // type, in which case it is spent
+    bool allow(sf::Uint64 sender, unsigned int type, sf::Time now);
+
+    // Stop tracking a sender which has gone away
+    void forget(sf::Uint64 sender) { mBuckets.erase(sender); }
+};
+
+#endif /* RATE_LIMITER_HPP */
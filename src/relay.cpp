@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "relay.hpp"
+
+Relay::Relay(const JsonBox::Value& v, NetworkManager* nmgr) :
+    mNmgr(nmgr),
+    mServerIp(sf::IpAddress::LocalHost),
+    mServerPort(49518),
+    mDelay(sf::seconds(2.0f)),
+    mRenewInterval(sf::seconds(2.0f)),
+    mViewerTimeout(sf::seconds(10.0f)),
+    mRunning(true)
+{
+    JsonBox::Object o = v.getObject();
+
+    auto has = [&o](const std::string& s) { return o.find(s) != o.end(); };
+
+    if(has("target"))
+    {
+        JsonBox::Object targetO = o["target"].getObject();
+        if(targetO.count("address") > 0)
+            mServerIp = sf::IpAddress(targetO["address"].getString());
+        if(targetO.count("port") > 0)
+            mServerPort = targetO["port"].tryGetInteger(mServerPort);
+    }
+    if(has("delay")) mDelay = sf::seconds(o["delay"].tryGetFloat(2.0f));
+    if(has("renewInterval")) mRenewInterval = sf::seconds(o["renewInterval"].tryGetFloat(2.0f));
+    if(has("viewerTimeout")) mViewerTimeout = sf::seconds(o["viewerTimeout"].tryGetFloat(10.0f));
+
+    servout << "Relaying " << mServerIp.toString() << ":" << mServerPort
+        << " " << mDelay.asSeconds() << "s behind" << std::endl;
+}
+
+Relay::~Relay()
+{
+    for(const auto& s : mStreams) subscribe(s.first, true);
+    mNmgr->update();
+}
+
+void Relay::run()
+{
+    while(mRunning)
+    {
+        NetworkManager::Event netEvent;
+        while(mNmgr->pollEvent(netEvent))
+        {
+            switch(netEvent.type)
+            {
+                default:
+                    break;
+                ///////////////////////////////////////////////////
+                // FROM SPECTATORS
+                ///////////////////////////////////////////////////
+                case NetworkManager::Event::Spectate:
+                    handleSpectate(netEvent);
+                    break;
+                case NetworkManager::Event::SnapshotAck:
+                    handleSnapshotAck(netEvent);
+                    break;
+                ///////////////////////////////////////////////////
+                // FROM THE SERVER
+                ///////////////////////////////////////////////////
+                // Spectators have connections too, so anything else
+                // claiming to be from the server is ignored
+                case NetworkManager::Event::Snapshot:
+                    if(!fromServer(netEvent)) break;
+                    buffer(netEvent.snapshot.gameId, netEvent);
+                    break;
+                case NetworkManager::Event::AutoAttack:
+                    if(!fromServer(netEvent)) break;
+                    buffer(netEvent.autoAttack.gameId, netEvent);
+                    break;
+                case NetworkManager::Event::Disconnect:
+                    if(!fromServer(netEvent)) break;
+                    // Same shutdown message as the server
+                    if(netEvent.disconnect.gameId == 65535 &&
+                        netEvent.disconnect.charId == 255)
+                    {
+                        mRunning = false;
+                        break;
+                    }
+                    buffer(netEvent.disconnect.gameId, netEvent);
+                    break;
+            }
+        }
+        for(auto& s : mStreams) release(s.second);
+        renew();
+        mNmgr->update();
+        // Snapshots come at most every tick, so this is plenty
+        sf::sleep(sf::milliseconds(5));
+    }
+}
+
+bool Relay::fromServer(const NetworkManager::Event& netEvent) const
+{
+    return netEvent.sender == mServerIp && netEvent.senderPort == mServerPort;
+}
+
+void Relay::handleSpectate(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.spectate;
+    // Spectators are known by where their packets come from, not by
+    // the address they wrote
+    const sf::IpAddress& ip = netEvent.sender;
+    sf::Uint16 port = netEvent.senderPort;
+    auto streamIt = mStreams.find(e.gameId);
+    if(e.leave)
+    {
+        if(streamIt == mStreams.end()) return;
+        auto& viewers = streamIt->second.viewers;
+        viewers.erase(std::remove_if(viewers.begin(), viewers.end(),
+            [&ip, port](const Viewer& v) { return v.ip == ip && v.port == port; }),
+            viewers.end());
+        return;
+    }
+
+    bool isNew = streamIt == mStreams.end();
+    Stream& stream = mStreams[e.gameId];
+    if(isNew)
+    {
+        subscribe(e.gameId, false);
+        stream.renew = mClock.getElapsedTime() + mRenewInterval;
+    }
+    auto it = std::find_if(stream.viewers.begin(), stream.viewers.end(),
+        [&ip, port](const Viewer& v) { return v.ip == ip && v.port == port; });
+    if(it == stream.viewers.end())
+    {
+        // Lowest id nobody is using, 255 is never given out
+        std::vector<bool> used(256, false);
+        for(const auto& v : stream.viewers) used[v.viewerId] = true;
+        sf::Uint8 viewerId = 0;
+        while(viewerId < 255 && used[viewerId]) ++viewerId;
+        if(viewerId == 255)
+        {
+            NetworkManager::Event response;
+            response.type = NetworkManager::Event::GameFull;
+            response.gameFull = {
+                .gameId = e.gameId
+            };
+            mNmgr->send(response, ip, port);
+            return;
+        }
+        servout << ip.toString() << ":" << port << " is watching game " << e.gameId << std::endl;
+        stream.viewers.push_back(Viewer());
+        it = stream.viewers.end() - 1;
+        it->ip = ip;
+        it->port = port;
+        it->viewerId = viewerId;
+        it->snapshotAck = 0;
+    }
+    it->expires = mClock.getElapsedTime() + mViewerTimeout;
+    // Confirm, and tell them which id to ack with
+    e.viewerId = it->viewerId;
+    mNmgr->send(netEvent, ip, port);
+}
+
+void Relay::handleSnapshotAck(NetworkManager::Event& netEvent)
+{
+    auto& e = netEvent.snapshotAck;
+    auto streamIt = mStreams.find(e.gameId);
+    if(streamIt == mStreams.end()) return;
+    for(auto& v : streamIt->second.viewers)
+    {
+        // Nobody else may ack on a viewer's behalf
+        if(v.viewerId != e.charId) continue;
+        if(v.ip != netEvent.sender || v.port != netEvent.senderPort) return;
+        if(e.sequence > v.snapshotAck) v.snapshotAck = e.sequence;
+        return;
+    }
+}
+
+void Relay::buffer(sf::Uint16 gameId, const NetworkManager::Event& netEvent)
+{
+    auto it = mStreams.find(gameId);
+    if(it == mStreams.end()) return;
+    it->second.buffer.push_back((Delayed){
+        .release = mClock.getElapsedTime() + mDelay,
+        .event = netEvent
+    });
+}
+
+void Relay::release(Stream& stream)
+{
+    sf::Time now = mClock.getElapsedTime();
+    while(!stream.buffer.empty() && stream.buffer.front().release <= now)
+    {
+        const NetworkManager::Event& netEvent = stream.buffer.front().event;
+        if(netEvent.type == NetworkManager::Event::Snapshot) sendSnapshot(stream, netEvent);
+        else
+        {
+            for(const auto& v : stream.viewers) mNmgr->send(netEvent, v.ip, v.port);
+        }
+        stream.buffer.pop_front();
+    }
+}
+
+// Same as the server does for its players, except every spectator
+// sees everything
+void Relay::sendSnapshot(Stream& stream, const NetworkManager::Event& netEvent)
+{
+    // The server always sends the whole game, so a delta didn't
+    // come from it
+    const Snapshot& snapshot = *netEvent.delta;
+    if(snapshot.baseline != 0) return;
+    NetworkManager::Event out = netEvent;
+    for(auto& v : stream.viewers)
+    {
+        const Snapshot* baseline = v.snapshots.get(v.snapshotAck);
+        Snapshot delta = snapshot.diff(baseline);
+        out.delta = std::make_shared<Snapshot>(delta);
+        mNmgr->send(out, v.ip, v.port);
+        v.snapshots.store(snapshot);
+    }
+}
+
+void Relay::renew()
+{
+    sf::Time now = mClock.getElapsedTime();
+    for(auto it = mStreams.begin(); it != mStreams.end();)
+    {
+        Stream& stream = it->second;
+        stream.viewers.erase(std::remove_if(stream.viewers.begin(), stream.viewers.end(),
+            [now](const Viewer& v) { return v.expires < now; }),
+            stream.viewers.end());
+        if(stream.viewers.empty())
+        {
+            servout << "Nobody is watching game " << it->first << " any more" << std::endl;
+            subscribe(it->first, true);
+            it = mStreams.erase(it);
+            continue;
+        }
+        if(now >= stream.renew)
+        {
+            subscribe(it->first, false);
+            stream.renew = now + mRenewInterval;
+        }
+        ++it;
+    }
+}
+
+void Relay::subscribe(sf::Uint16 gameId, bool leave)
+{
+    NetworkManager::Event netEvent;
+    netEvent.type = NetworkManager::Event::Spectate;
+    netEvent.spectate = {
+        .ip = mNmgr->getAddressFor(mServerIp),
+        .port = mNmgr->getPort(),
+        .gameId = gameId,
+        .viewerId = 255,
+        .leave = leave
+    };
+    mNmgr->send(netEvent, mServerIp, mServerPort);
+}
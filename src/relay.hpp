@@ -0,0 +1,91 @@
+#ifndef RELAY_HPP
+#define RELAY_HPP
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "network_manager.hpp"
+#include "snapshot.hpp"
+
+// Streams games to spectators on behalf of a server. The relay
+// subscribes to each game being watched once, receives a whole
+// snapshot each time the server takes one, and sends every spectator
+// of that game a delta against whatever they last acknowledged.
+// Spectators never reach the server, so however many there are the
+// server only pays for one more recipient per game. Everything can be
+// held back by a delay, so spectators can't be used to scout
+class Relay
+{
+private:
+
+    struct Viewer
+    {
+        sf::IpAddress ip;
+        sf::Uint16 port;
+        // Used in place of a charId when acking snapshots
+        sf::Uint8 viewerId;
+        SnapshotHistory snapshots;
+        sf::Uint32 snapshotAck;
+        // Dropped at this time unless they ask to spectate again
+        sf::Time expires;
+    };
+
+    // Event from the server waiting out the delay
+    struct Delayed
+    {
+        sf::Time release;
+        NetworkManager::Event event;
+    };
+
+    struct Stream
+    {
+        std::vector<Viewer> viewers;
+        std::deque<Delayed> buffer;
+        // When to next renew the subscription with the server
+        sf::Time renew;
+    };
+
+    NetworkManager* mNmgr;
+    sf::IpAddress mServerIp;
+    unsigned short mServerPort;
+    sf::Time mDelay;
+    sf::Time mRenewInterval;
+    sf::Time mViewerTimeout;
+    std::map<sf::Uint16, Stream> mStreams;
+    sf::Clock mClock;
+    std::atomic<bool> mRunning;
+
+    // Whether an event came from the server being relayed
+    bool fromServer(const NetworkManager::Event& netEvent) const;
+    void handleSpectate(NetworkManager::Event& netEvent);
+    void handleSnapshotAck(NetworkManager::Event& netEvent);
+    // Hold an event from the server until the delay is up
+    void buffer(sf::Uint16 gameId, const NetworkManager::Event& netEvent);
+
+    // Pass on whatever has waited long enough
+    void release(Stream& stream);
+    void sendSnapshot(Stream& stream, const NetworkManager::Event& netEvent);
+    // Renew subscriptions to games being watched, and give up on
+    // spectators and games nobody is watching any more
+    void renew();
+    void subscribe(sf::Uint16 gameId, bool leave);
+
+public:
+
+    // Read the relay block of the config, which says which server to
+    // relay and how far behind to run
+    Relay(const JsonBox::Value& v, NetworkManager* nmgr);
+    ~Relay();
+
+    // Run until the server sends the shutdown message, or stop is called
+    void run();
+    // Safe to call from any thread
+    void stop() { mRunning = false; }
+};
+
+#endif /* RELAY_HPP */
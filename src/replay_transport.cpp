@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <string>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "replay_transport.hpp"
+
+ReplayTransport::ReplayTransport(const std::string& path, float speed) :
+    mReader(path),
+    mSpeed(speed),
+    mHasNext(false),
+    mStarted(false),
+    mFinished(false),
+    mReplayed(0),
+    mSent(0),
+    mSentBytes(0)
+{
+    mHasNext = mReader.next(mNext);
+    mFinished = !mHasNext;
+}
+
+sf::Socket::Status ReplayTransport::send(sf::Packet& packet,
+    const sf::IpAddress& remoteAddress, unsigned short remotePort)
+{
+    ++mSent;
+    mSentBytes += packet.getDataSize();
+    return sf::Socket::Done;
+}
+
+sf::Socket::Status ReplayTransport::receive(sf::Packet& packet,
+    sf::IpAddress& remoteAddress, unsigned short& remotePort)
+{
+    if(!mHasNext)
+    {
+        sf::sleep(sf::milliseconds(100));
+        return sf::Socket::NotReady;
+    }
+    // The capture's clock starts when the first packet is wanted
+    if(!mStarted)
+    {
+        mClock.restart();
+        mStarted = true;
+    }
+
+    if(mSpeed > 0.0f)
+    {
+        sf::Int64 due = static_cast<sf::Int64>(mNext.time / mSpeed);
+        sf::Int64 wait = due - mClock.getElapsedTime().asMicroseconds();
+        if(wait > 0)
+        {
+            // Don't block for long, so the caller can stop
+            sf::sleep(sf::microseconds(std::min<sf::Int64>(wait, 100000)));
+            if(wait > 100000) return sf::Socket::NotReady;
+        }
+    }
+
+    packet.clear();
+    if(!mNext.data.empty()) packet.append(&mNext.data[0], mNext.data.size());
+    remoteAddress = mNext.ip;
+    remotePort = mNext.port;
+    ++mReplayed;
+
+    mHasNext = mReader.next(mNext);
+    if(!mHasNext) mFinished = true;
+    return sf::Socket::Done;
+}
@@ -0,0 +1,53 @@
+#ifndef REPLAY_TRANSPORT_HPP
+#define REPLAY_TRANSPORT_HPP
+
+#include <atomic>
+#include <string>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "transport.hpp"
+#include "packet_capture.hpp"
+
+// Transport which receives the datagrams from a capture file, at the
+// times they were captured divided by speed. A speed of 0 replays
+// them as fast as they can be taken. Anything sent is counted and
+// thrown away
+class ReplayTransport : public Transport
+{
+private:
+
+    CaptureReader mReader;
+    float mSpeed;
+    CaptureRecord mNext;
+    bool mHasNext;
+    bool mStarted;
+    sf::Clock mClock;
+
+    std::atomic<bool> mFinished;
+    std::atomic<sf::Uint64> mReplayed;
+    std::atomic<sf::Uint64> mSent;
+    std::atomic<sf::Uint64> mSentBytes;
+
+public:
+
+    ReplayTransport(const std::string& path, float speed);
+
+    sf::Socket::Status send(sf::Packet& packet,
+        const sf::IpAddress& remoteAddress, unsigned short remotePort);
+    sf::Socket::Status receive(sf::Packet& packet,
+        sf::IpAddress& remoteAddress, unsigned short& remotePort);
+    unsigned short getLocalPort() const { return 0; }
+    sf::IpAddress getAddressFor(const sf::IpAddress& remoteAddress) const
+    {
+        return sf::IpAddress::LocalHost;
+    }
+
+    // True once every datagram has been received
+    bool finished() const { return mFinished; }
+    sf::Uint64 replayed() const { return mReplayed; }
+    sf::Uint64 sent() const { return mSent; }
+    sf::Uint64 sentBytes() const { return mSentBytes; }
+};
+
+#endif /* REPLAY_TRANSPORT_HPP */
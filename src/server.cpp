@@ -0,0 +1,270 @@
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "server.hpp"
+#include "tick_scheduler.hpp"
+
+Server::Server(const JsonBox::Value& v, NetworkManager* nmgr, EntityManager* mgr) :
+    mNmgr(nmgr),
+    mMgr(mgr),
+    mRunning(true),
+    mStats((Stats){ 0, 0, 0, 0, 0, sf::Time::Zero, sf::Time::Zero })
+{
+    mSettings.load(v);
+    mTimeoutTicks = std::max(sf::Uint64(1),
+        sf::Uint64(mSettings.clientTimeout * mSettings.tickRate));
+    unsigned int workers = mSettings.workers;
+    if(workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned int i = 0; i < workers; ++i)
+    {
+        mWorkers.push_back(std::unique_ptr<GameWorker>(new GameWorker(mNmgr, mMgr, &mSettings)));
+    }
+    servout << "Running games across " << workers << " workers" << std::endl;
+}
+
+void Server::run()
+{
+    TickScheduler scheduler(mSettings.tickRate, mSettings.maxCatchUpTicks);
+    sf::Clock reportClock;
+    sf::Time reportBusy = sf::Time::Zero;
+
+    while(mRunning)
+    {
+        // Sleep until the next tick, then hand the network events which
+        // arrived in the meantime to the workers on the tick boundary
+        scheduler.wait();
+        sf::Clock busy;
+        unsigned int ticks = scheduler.advance();
+        sf::Uint64 overruns = scheduler.overruns();
+
+        NetworkManager::Event netEvent;
+        while(mNmgr->pollEvent(netEvent))
+        {
+            route(netEvent);
+            ++mStats.events;
+        }
+        expire(scheduler.tick());
+
+        // Run every worker's games in parallel, then merge what they
+        // want sending
+        for(auto& w : mWorkers) w->start(ticks, scheduler.dt());
+        mStats.coalesced = 0;
+        for(auto& w : mWorkers)
+        {
+            w->finish();
+            flush(*w);
+            mStats.coalesced += w->coalesced();
+        }
+        // Resend whatever the clients haven't acked
+        mNmgr->update();
+
+        if(scheduler.overruns() > overruns)
+        {
+            servout << "Fell behind by more than " << mSettings.maxCatchUpTicks
+                << " ticks, dropped " << scheduler.overruns() - overruns << std::endl;
+        }
+
+        sf::Time elapsed = busy.getElapsedTime();
+        ++mStats.loops;
+        mStats.ticks += ticks;
+        mStats.overruns = scheduler.overruns();
+        mStats.busy += elapsed;
+        mStats.maxBusy = std::max(mStats.maxBusy, elapsed);
+
+        reportBusy += elapsed;
+        if(mSettings.lobbyPort != 0 &&
+            reportClock.getElapsedTime().asSeconds() >= mSettings.reportInterval)
+        {
+            report(reportBusy, reportClock.restart());
+            reportBusy = sf::Time::Zero;
+        }
+    }
+}
+
+void Server::report(sf::Time busy, sf::Time elapsed)
+{
+    size_t games = 0;
+    for(const auto& w : mWorkers) games += w->games();
+    NetworkManager::Event netEvent;
+    netEvent.type = NetworkManager::Event::ShardReport;
+    netEvent.shardReport = {
+        .port = mNmgr->getPort(),
+        .games = static_cast<sf::Uint16>(games),
+        .players = static_cast<sf::Uint16>(mClients.size()),
+        .load = elapsed > sf::Time::Zero ? busy.asSeconds() / elapsed.asSeconds() : 0.0f
+    };
+    mNmgr->send(netEvent, sf::IpAddress::LocalHost, mSettings.lobbyPort);
+}
+
+void Server::route(NetworkManager::Event& netEvent)
+{
+    switch(netEvent.type)
+    {
+        default:
+        case NetworkManager::Event::Nop:
+        {
+            break;
+        }
+        ///////////////////////////////////////////////////
+        // CONNECT
+        ///////////////////////////////////////////////////
+        case NetworkManager::Event::Connect:
+        {
+            auto& e = netEvent.connect;
+            // The address written in the message can't be trusted, and
+            // behind NAT isn't even the one we'd reach them on, so they
+            // are known by where their packets come from
+            const sf::IpAddress& ip = netEvent.sender;
+            sf::Uint16 port = netEvent.senderPort;
+            if(mClients.find(ip, port) != ClientRegistry::invalid)
+            {
+                servout << ip.toString() << ":" << port << " is already connected" << std::endl;
+                break;
+            }
+            // The worker decides whether there's room, so hold their
+            // place until it does
+            touch(mClients.add((ClientRegistry::Client){
+                .ip = ip,
+                .port = port,
+                .gameId = e.gameId,
+                .charId = 255
+            }));
+            workerFor(e.gameId).push(netEvent);
+            break;
+        }
+        ///////////////////////////////////////////////////
+        // DISCONNECT
+        ///////////////////////////////////////////////////
+        case NetworkManager::Event::Disconnect:
+        {
+            // Terribly unsecure way of killing server gracefully
+            if(netEvent.disconnect.gameId == 65535 &&
+                netEvent.disconnect.charId == 255)
+            {
+                mRunning = false;
+            }
+            // Same as a connect event but in reverse
+            auto& e = netEvent.disconnect;
+            ClientHandle h = mClients.find(e.gameId, e.charId);
+            const ClientRegistry::Client* client = mClients.get(h);
+            if(client == nullptr)
+            {
+                servout << netEvent.sender.toString() << " is not connected" << std::endl;
+            }
+            // Only the client itself may disconnect its character
+            else if(client->ip == netEvent.sender && client->port == netEvent.senderPort)
+            {
+                servout << client->ip.toString() << " has disconnected" << std::endl;
+                // Delete from the set of connected clients, then let the
+                // game's worker tell everyone else
+                mTimeouts.cancel(h.index);
+                mNmgr->forget(client->ip, client->port);
+                mClients.remove(h);
+                workerFor(e.gameId).push(netEvent);
+            }
+            break;
+        }
+        ///////////////////////////////////////////////////
+        // GAME EVENTS
+        ///////////////////////////////////////////////////
+        case NetworkManager::Event::Move:
+            touch(netEvent.sender, netEvent.senderPort);
+            workerFor(netEvent.move.gameId).push(netEvent);
+            break;
+        case NetworkManager::Event::Damage:
+            touch(netEvent.sender, netEvent.senderPort);
+            workerFor(netEvent.damage.gameId).push(netEvent);
+            break;
+        case NetworkManager::Event::AutoAttack:
+            touch(netEvent.sender, netEvent.senderPort);
+            workerFor(netEvent.autoAttack.gameId).push(netEvent);
+            break;
+        case NetworkManager::Event::SnapshotAck:
+            touch(netEvent.sender, netEvent.senderPort);
+            workerFor(netEvent.snapshotAck.gameId).push(netEvent);
+            break;
+        ///////////////////////////////////////////////////
+        // SPECTATE
+        ///////////////////////////////////////////////////
+        // Relays aren't players, so aren't tracked as clients. They
+        // keep their subscription by renewing it
+        case NetworkManager::Event::Spectate:
+            workerFor(netEvent.spectate.gameId).push(netEvent);
+            break;
+        ///////////////////////////////////////////////////
+        // KEEPALIVE
+        ///////////////////////////////////////////////////
+        case NetworkManager::Event::Keepalive:
+            touch(netEvent.sender, netEvent.senderPort);
+            break;
+    }
+}
+
+void Server::touch(const sf::IpAddress& ip, sf::Uint16 port)
+{
+    touch(mClients.find(ip, port));
+}
+
+void Server::touch(ClientHandle h)
+{
+    if(mClients.get(h) == nullptr) return;
+    mTimeouts.set(h.index, mTimeouts.now() + mTimeoutTicks);
+}
+
+void Server::expire(sf::Uint64 tick)
+{
+    std::vector<sf::Uint32> expired;
+    mTimeouts.advance(tick, expired);
+    for(auto index : expired)
+    {
+        ClientHandle h = mClients.at(index);
+        const ClientRegistry::Client* client = mClients.get(h);
+        if(client == nullptr) continue;
+        // Still waiting on their game, so it isn't their fault
+        if(client->charId == 255)
+        {
+            touch(h);
+            continue;
+        }
+
+        servout << client->ip.toString() << " timed out" << std::endl;
+        // Disconnect them just as if they'd asked to
+        NetworkManager::Event netEvent;
+        netEvent.type = NetworkManager::Event::Disconnect;
+        netEvent.disconnect = {
+            .ip = client->ip,
+            .port = client->port,
+            .gameId = client->gameId,
+            .charId = client->charId
+        };
+        mClients.remove(h);
+        mNmgr->forget(netEvent.disconnect.ip, netEvent.disconnect.port);
+        workerFor(netEvent.disconnect.gameId).push(netEvent);
+    }
+}
+
+void Server::flush(GameWorker& worker)
+{
+    for(const auto& j : worker.joined())
+    {
+        ClientHandle h = mClients.find(j.ip, j.port);
+        if(j.accepted) mClients.setCharId(h, j.charId);
+        else
+        {
+            mTimeouts.cancel(h.index);
+            mClients.remove(h);
+        }
+    }
+    worker.joined().clear();
+
+    for(const auto& o : worker.outbox())
+    {
+        mNmgr->send(o.event, o.ip, o.port);
+    }
+    worker.outbox().clear();
+}
@@ -0,0 +1,87 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "network_manager.hpp"
+#include "entity_manager.hpp"
+#include "game_worker.hpp"
+#include "server_settings.hpp"
+#include "client_registry.hpp"
+#include "timer_wheel.hpp"
+
+// Keeps track of connected clients and routes incoming events to the
+// GameWorker which owns the game they're for. Games are spread across
+// workers by gameId, so each worker runs its games in parallel with
+// the others
+class Server
+{
+public:
+
+    // How hard the server has been working, for load testing
+    struct Stats
+    {
+        sf::Uint64 loops; // One per wake up, which may run several ticks
+        sf::Uint64 ticks;
+        sf::Uint64 overruns;
+        sf::Uint64 events; // Network events routed
+        sf::Uint64 coalesced; // Moves replaced by a newer one
+        sf::Time busy;     // Time spent not sleeping
+        sf::Time maxBusy;  // Longest single loop
+    };
+
+private:
+
+    // Currently connected clients. Clients which have asked to
+    // connect but have not yet been accepted or rejected by their
+    // game's worker have a charId of 255
+    ClientRegistry mClients;
+    // When each client times out, by registry slot. Pushed back
+    // whenever they send anything
+    TimerWheel mTimeouts;
+    sf::Uint64 mTimeoutTicks;
+
+    NetworkManager* mNmgr;
+    EntityManager* mMgr;
+    ServerSettings mSettings;
+    std::vector<std::unique_ptr<GameWorker>> mWorkers;
+    std::atomic<bool> mRunning;
+    Stats mStats;
+
+    GameWorker& workerFor(sf::Uint16 gameId)
+    {
+        return *mWorkers[gameId % mWorkers.size()];
+    }
+
+    void route(NetworkManager::Event& netEvent);
+    // The client at this address has been heard from, so push back
+    // their timeout. Found by where the packet came from, since the
+    // ids in its payload could name anyone
+    void touch(const sf::IpAddress& ip, sf::Uint16 port);
+    void touch(ClientHandle h);
+    // Disconnect everyone who hasn't been heard from by the given tick
+    void expire(sf::Uint64 tick);
+    // Send everything a worker produced and record who joined
+    void flush(GameWorker& worker);
+    // Tell the lobby how busy we've been, if we're a shard
+    void report(sf::Time busy, sf::Time elapsed);
+
+public:
+
+    Server(const JsonBox::Value& v, NetworkManager* nmgr, EntityManager* mgr);
+
+    // Run until a client sends the shutdown message, or stop is called
+    void run();
+    // Safe to call from any thread
+    void stop() { mRunning = false; }
+
+    // Only safe to read once run has returned
+    const Stats& stats() const { return mStats; }
+};
+
+#endif /* SERVER_HPP */
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <string>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "server_settings.hpp"
+#include "constants.hpp"
+
+ServerSettings::ServerSettings() :
+    tickRate(60.0f),
+    maxCatchUpTicks(5),
+    workers(0),
+    snapshotRate(0.0f),
+    moveTolerance(0.25f),
+    clientTimeout(10.0f),
+    interestMargin(2.0f),
+    interestHysteresis(1.0f),
+    interestCellSize(8),
+    bandwidth(0.0f),
+    bandwidthBurst(0.25f),
+    priorityDistanceScale(8.0f),
+    priorityHpWeight(4.0f),
+    rangeTolerance(0.1f),
+    interpolationDelay(0.1f),
+    maxRewind(0.5f),
+    maxSubscribers(4),
+    lobbyPort(0),
+    reportInterval(1.0f)
+{
+}
+
+void ServerSettings::load(const JsonBox::Value& v)
+{
+    JsonBox::Object o = v.getObject();
+
+    auto has = [&o](const std::string& s) { return o.find(s) != o.end(); };
+
+    // Each tick lasts 1/tickRate seconds, so it has to be positive
+    if(has("tickRate")) tickRate = std::max(1.0f, o["tickRate"].tryGetFloat(tickRate));
+    // At least the tick that's due has to run
+    if(has("maxCatchUpTicks")) maxCatchUpTicks = std::max(1, o["maxCatchUpTicks"].tryGetInteger(maxCatchUpTicks));
+    if(has("workers")) workers = o["workers"].tryGetInteger(workers);
+    if(has("snapshotRate")) snapshotRate = o["snapshotRate"].tryGetFloat(snapshotRate);
+    if(has("moveTolerance")) moveTolerance = o["moveTolerance"].tryGetFloat(moveTolerance);
+    if(has("clientTimeout")) clientTimeout = o["clientTimeout"].tryGetFloat(clientTimeout);
+
+    if(has("interest"))
+    {
+        JsonBox::Object interestO = o["interest"].getObject();
+        if(interestO.count("margin") > 0)
+            interestMargin = interestO["margin"].tryGetFloat(interestMargin);
+        if(interestO.count("hysteresis") > 0)
+            interestHysteresis = interestO["hysteresis"].tryGetFloat(interestHysteresis);
+        // The map is divided by the cell size
+        if(interestO.count("cellSize") > 0)
+            interestCellSize = std::max(1, interestO["cellSize"].tryGetInteger(interestCellSize));
+    }
+
+    if(has("bandwidth"))
+    {
+        JsonBox::Object bandwidthO = o["bandwidth"].getObject();
+        if(bandwidthO.count("budget") > 0)
+            bandwidth = bandwidthO["budget"].tryGetFloat(bandwidth);
+        if(bandwidthO.count("burst") > 0)
+            bandwidthBurst = bandwidthO["burst"].tryGetFloat(bandwidthBurst);
+        if(bandwidthO.count("distanceScale") > 0)
+            priorityDistanceScale = bandwidthO["distanceScale"].tryGetFloat(priorityDistanceScale);
+        if(bandwidthO.count("hpWeight") > 0)
+            priorityHpWeight = bandwidthO["hpWeight"].tryGetFloat(priorityHpWeight);
+    }
+
+    if(has("lagCompensation"))
+    {
+        JsonBox::Object lagO = o["lagCompensation"].getObject();
+        if(lagO.count("rangeTolerance") > 0)
+            rangeTolerance = lagO["rangeTolerance"].tryGetFloat(rangeTolerance);
+        if(lagO.count("interpolationDelay") > 0)
+            interpolationDelay = lagO["interpolationDelay"].tryGetFloat(interpolationDelay);
+        if(lagO.count("maxRewind") > 0)
+            maxRewind = lagO["maxRewind"].tryGetFloat(maxRewind);
+    }
+
+    if(has("spectate"))
+    {
+        JsonBox::Object spectateO = o["spectate"].getObject();
+        if(spectateO.count("relays") > 0)
+        {
+            relays.clear();
+            for(const auto& relay : spectateO["relays"].getArray())
+            {
+                sf::IpAddress ip(relay.getString());
+                if(ip != sf::IpAddress::None) relays.push_back(ip);
+            }
+        }
+        if(spectateO.count("maxSubscribers") > 0)
+            maxSubscribers = spectateO["maxSubscribers"].tryGetInteger(maxSubscribers);
+    }
+
+    if(has("lobby"))
+    {
+        JsonBox::Object lobbyO = o["lobby"].getObject();
+        if(lobbyO.count("port") > 0)
+            lobbyPort = lobbyO["port"].tryGetInteger(lobbyPort);
+        if(lobbyO.count("reportInterval") > 0)
+            reportInterval = lobbyO["reportInterval"].tryGetFloat(reportInterval);
+    }
+}
+
+sf::Vector2f ServerSettings::interestRadius() const
+{
+    return sf::Vector2f(
+        ld::widthTiles / 2.0f + interestMargin,
+        ld::heightTiles / 2.0f + interestMargin);
+}
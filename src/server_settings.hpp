@@ -0,0 +1,87 @@
+#ifndef SERVER_SETTINGS_HPP
+#define SERVER_SETTINGS_HPP
+
+#include <vector>
+#include <JsonBox.h>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+// Tunables for the server, read from the server block of config.json.
+// Anything missing keeps its default
+class ServerSettings
+{
+public:
+    // The simulation runs at a fixed tickRate, sleeping between
+    // ticks. If it falls behind it runs up to maxCatchUpTicks ticks
+    // back to back to catch up
+    float tickRate;
+    unsigned int maxCatchUpTicks;
+
+    // Number of threads games are spread across. 0 uses one per core
+    unsigned int workers;
+
+    // Snapshots of every game are sent to clients snapshotRate
+    // times a second, instead of rebroadcasting each Move. A rate
+    // of 0 falls back to event driven syncing
+    float snapshotRate;
+
+    // How many seconds of movement a client's position may be ahead of
+    // the server's before the server corrects it. Either way it may not
+    // have moved faster than its speed since its last accepted position
+    float moveTolerance;
+
+    // Clients which haven't been heard from for this many seconds
+    // are disconnected
+    float clientTimeout;
+
+    // Players are sent updates about characters within their screen
+    // plus a margin. Characters on the edge are kept until they're
+    // a further hysteresis tiles away
+    float interestMargin;
+    float interestHysteresis;
+    unsigned int interestCellSize;
+
+    // Bytes per second of snapshots each client may be sent, or 0 for
+    // no limit. When there isn't room for everything, characters are
+    // sent in order of accumulated priority. Priority builds up faster
+    // for characters nearer the player (halving every distanceScale
+    // tiles), and hpWeight times faster when hp or mp has changed.
+    // Unsent bandwidth carries over for up to burst seconds
+    float bandwidth;
+    float bandwidthBurst;
+    float priorityDistanceScale;
+    float priorityHpWeight;
+
+    // Auto attacks are checked against where the target was when the
+    // attacker clicked on them. Clients draw others interpolationDelay
+    // seconds in the past, and their click took a round trip to show
+    // up here, so the target is rewound by both, but never by more
+    // than maxRewind seconds. Clients only check the click was within
+    // ld::attackRange of the attacker and ld::clickRadius of the
+    // target, so the attacker must be within the sum of those plus
+    // rangeTolerance tiles of that position. The tolerance covers
+    // what rewinding gets wrong
+    float rangeTolerance;
+    float interpolationDelay;
+    float maxRewind;
+
+    // Relays see every character in a game, so only these addresses
+    // may subscribe to one, and no more than maxSubscribers at once
+    std::vector<sf::IpAddress> relays;
+    unsigned int maxSubscribers;
+
+    // Set when running as one shard of a lobby, which this reports
+    // how busy it is to every reportInterval seconds. 0 if standalone
+    unsigned short lobbyPort;
+    float reportInterval;
+
+    ServerSettings();
+
+    void load(const JsonBox::Value& v);
+
+    // Half extents of the area around each player they are sent
+    // updates about
+    sf::Vector2f interestRadius() const;
+};
+
+#endif /* SERVER_SETTINGS_HPP */
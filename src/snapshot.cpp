@@ -0,0 +1,137 @@
+#include <map>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "snapshot.hpp"
+#include "game_container.hpp"
+#include "network_manager.hpp"
+
+Snapshot::Snapshot(const GameContainer& game, sf::Uint32 sequence) :
+    sequence(sequence),
+    baseline(0)
+{
+    for(const auto& ch : game.characters)
+    {
+        size_t i = game.store.index(ch.second.entity);
+        characters[ch.first] = (CharState){
+            .fields = Field::All,
+            .team = ch.second.team,
+            .pos = game.store.pos[i],
+            .target = ch.second.pfHelper.target,
+            .hp = game.store.hp[i],
+            .mp = game.store.mp[i]
+        };
+    }
+}
+
+Snapshot Snapshot::diff(const Snapshot* baseline) const
+{
+    Snapshot delta;
+    delta.sequence = sequence;
+    delta.baseline = baseline == nullptr ? 0 : baseline->sequence;
+    for(const auto& ch : characters)
+    {
+        CharState state = ch.second;
+        // Characters the baseline doesn't know about are sent in full
+        if(baseline != nullptr && baseline->characters.count(ch.first) > 0)
+        {
+            const CharState& old = baseline->characters.at(ch.first);
+            state.fields = 0;
+            if(state.team != old.team)      state.fields |= Field::Team;
+            if(state.pos != old.pos)        state.fields |= Field::Pos;
+            if(state.target != old.target)  state.fields |= Field::Target;
+            if(state.hp != old.hp)          state.fields |= Field::Hp;
+            if(state.mp != old.mp)          state.fields |= Field::Mp;
+        }
+        else
+        {
+            state.fields = Field::All;
+        }
+        if(state.fields != 0) delta.characters[ch.first] = state;
+    }
+    if(baseline == nullptr) return delta;
+    // Without these the receiver would keep characters which have left
+    for(const auto& ch : baseline->characters)
+    {
+        if(characters.count(ch.first) > 0) continue;
+        CharState state = {};
+        state.fields = Field::Removed;
+        delta.characters[ch.first] = state;
+    }
+    return delta;
+}
+
+Snapshot Snapshot::merge(const Snapshot& baseline) const
+{
+    Snapshot full = baseline;
+    full.sequence = sequence;
+    full.baseline = 0;
+    for(const auto& ch : characters)
+    {
+        const CharState& d = ch.second;
+        if(d.fields & Field::Removed)
+        {
+            full.characters.erase(ch.first);
+            continue;
+        }
+        CharState& s = full.characters[ch.first];
+        if(d.fields & Field::Team)      s.team = d.team;
+        if(d.fields & Field::Pos)       s.pos = d.pos;
+        if(d.fields & Field::Target)    s.target = d.target;
+        if(d.fields & Field::Hp)        s.hp = d.hp;
+        if(d.fields & Field::Mp)        s.mp = d.mp;
+        s.fields |= d.fields;
+    }
+    return full;
+}
+
+void Snapshot::write(sf::Packet& packet) const
+{
+    packet << sequence << baseline << static_cast<sf::Uint8>(characters.size());
+    for(const auto& ch : characters)
+    {
+        const CharState& s = ch.second;
+        packet << ch.first << s.fields;
+        if(s.fields & Field::Team)      packet << static_cast<sf::Uint8>(s.team);
+        if(s.fields & Field::Pos)       packet << s.pos;
+        if(s.fields & Field::Target)    packet << s.target;
+        if(s.fields & Field::Hp)        packet << s.hp;
+        if(s.fields & Field::Mp)        packet << s.mp;
+    }
+}
+
+size_t Snapshot::size(const CharState& s)
+{
+    size_t bytes = 2;
+    if(s.fields & Field::Team)      bytes += 1;
+    if(s.fields & Field::Pos)       bytes += 8;
+    if(s.fields & Field::Target)    bytes += 8;
+    if(s.fields & Field::Hp)        bytes += 4;
+    if(s.fields & Field::Mp)        bytes += 4;
+    return bytes;
+}
+
+bool Snapshot::read(sf::Packet& packet)
+{
+    sf::Uint8 count = 0;
+    if(!(packet >> sequence >> baseline >> count)) return false;
+    characters.clear();
+    for(int i = 0; i < count; ++i)
+    {
+        sf::Uint8 charId = 0;
+        CharState s = {};
+        if(!(packet >> charId >> s.fields)) return false;
+        if(s.fields & Field::Team)
+        {
+            sf::Uint8 team = 0;
+            if(!(packet >> team)) return false;
+            s.team = static_cast<GameContainer::Team>(team);
+        }
+        if(s.fields & Field::Pos && !(packet >> s.pos)) return false;
+        if(s.fields & Field::Target && !(packet >> s.target)) return false;
+        if(s.fields & Field::Hp && !(packet >> s.hp)) return false;
+        if(s.fields & Field::Mp && !(packet >> s.mp)) return false;
+        characters[charId] = s;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <map>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "game_container.hpp"
+
+// Replicated state of the characters in a game at a point in time.
+// The server sends these periodically, delta compressed against the
+// last snapshot the receiving client acknowledged, so only the fields
+// which have actually changed go over the wire. A snapshot read from
+// a packet is a delta, and has to be merged onto its baseline before
+// it describes the whole game again
+class Snapshot
+{
+public:
+
+    // Bitmask of which fields of a CharState are present. Removed
+    // carries no fields, it marks a character the baseline has but
+    // which has since left the game
+    enum Field
+    {
+        Team    = 1 << 0,
+        Pos     = 1 << 1,
+        Target  = 1 << 2,
+        Hp      = 1 << 3,
+        Mp      = 1 << 4,
+        All     = (1 << 5) - 1,
+        Removed = 1 << 5
+    };
+
+    struct CharState
+    {
+        sf::Uint8 fields;
+        GameContainer::Team team;
+        sf::Vector2f pos;
+        sf::Vector2f target;
+        float hp;
+        float mp;
+    };
+
+    // Sequence numbers start at 1, so a baseline of 0 means the
+    // snapshot is not a delta and contains everything
+    sf::Uint32 sequence;
+    sf::Uint32 baseline;
+    std::map<sf::Uint8, CharState> characters;
+
+    Snapshot() : sequence(0), baseline(0) {}
+    // Capture the current state of every character in the game
+    Snapshot(const GameContainer& game, sf::Uint32 sequence);
+
+    // Return only the characters and fields which differ from the
+    // baseline, plus a Removed entry for each character the baseline
+    // has that this doesn't. If baseline is null, everything is included
+    Snapshot diff(const Snapshot* baseline) const;
+
+    // Apply this delta on top of the baseline it was made against,
+    // returning the full snapshot without any removed characters
+    Snapshot merge(const Snapshot& baseline) const;
+
+    // Serialise the fields that are present
+    void write(sf::Packet& packet) const;
+    // Bytes write uses for one character, and for everything else
+    static size_t size(const CharState& s);
+    static const size_t headerSize = 9;
+    bool read(sf::Packet& packet);
+};
+
+// Fixed size ring of the most recent snapshots, indexed by sequence
+// number. Old snapshots are overwritten as new ones are stored
+class SnapshotHistory
+{
+private:
+    static const unsigned int size = 32;
+    Snapshot mSnapshots[size];
+
+public:
+
+    void store(const Snapshot& snapshot)
+    {
+        mSnapshots[snapshot.sequence % size] = snapshot;
+    }
+
+    // Return the snapshot with the given sequence, or nullptr if it
+    // was never stored or has since been overwritten
+    const Snapshot* get(sf::Uint32 sequence) const
+    {
+        if(sequence == 0) return nullptr;
+        const Snapshot& s = mSnapshots[sequence % size];
+        return s.sequence == sequence ? &s : nullptr;
+    }
+};
+
+#endif /* SNAPSHOT_HPP */
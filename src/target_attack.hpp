@@ -2,7 +2,9 @@
 #define TARGET_ATTACK_HPP
 
 #include <SFML/System.hpp>
+#ifndef LD_HEADLESS
 #include <SFML/Graphics.hpp>
+#endif
 
 #include <functional>
 #include <string>
@@ -17,7 +19,10 @@
 // executed, applying the attack. The function should accept two
 // CharWrappers corresponding to the source and target, then create and
 // return a NetEvent which encapsulates the attack
-class TargetAttack : public sf::Drawable
+class TargetAttack
+#ifndef LD_HEADLESS
+    : public sf::Drawable
+#endif
 {
 private:
 
@@ -37,7 +42,9 @@ private:
         GameContainer::CharWrapper*)> mFunc;
     GameContainer* mGame;
 
+#ifndef LD_HEADLESS
     sf::Sprite mSprite;
+#endif
 
     NetworkManager::Event mNetEvent;
 
@@ -63,10 +70,12 @@ public:
         mFunc(f),
         mGame(game)
     {
-        mSprite.setTexture(mTileset->tex);
         mAnim = &mTileset->animations[animation];
+#ifndef LD_HEADLESS
+        mSprite.setTexture(mTileset->tex);
         mSprite.setTextureRect(sf::IntRect(mAnim->x, mAnim->y, mTs, mTs));
         mSprite.setOrigin(mTs/2.0, mTs/2.0);
+#endif
     }
 
     // Returns true on the frame that the event is called
@@ -83,11 +92,13 @@ public:
         // No point changing the frame when it doesn't need to be
         if(frame != mAnimCurrentFrame)
         {
+#ifndef LD_HEADLESS
             mSprite.setTextureRect(sf::IntRect(
                     mAnim->x + frame * mTs,
                     mAnim->y,
                     mTs,
                     mTs));
+#endif
             mAnimCurrentFrame = frame;
         }
         if(frame == mTriggerFrame)
@@ -109,14 +120,17 @@ public:
         return false;
     }
 
-    void setPos(const sf::Vector2f& pos) { mSprite.setPosition(pos); }
     bool isDone() const { return mIsDone; }
     NetworkManager::Event getEvent() const { return mNetEvent; }
 
+#ifndef LD_HEADLESS
+    void setPos(const sf::Vector2f& pos) { mSprite.setPosition(pos); }
+
     void draw(sf::RenderTarget& target, sf::RenderStates states) const
     {
         target.draw(mSprite, states);
     }
+#endif
 };
 
 #endif /* TARGET_ATTACK_HPP */
@@ -0,0 +1,40 @@
+#include <thread>
+#include <SFML/System.hpp>
+
+#include "tick_scheduler.hpp"
+
+TickScheduler::TickScheduler(float rate, unsigned int maxCatchUp) :
+    mTickLength(sf::seconds(1.0f / rate)),
+    mAccumulator(sf::Time::Zero),
+    mMaxCatchUp(maxCatchUp),
+    mTick(0),
+    mOverruns(0)
+{
+}
+
+void TickScheduler::wait()
+{
+    // The OS is only accurate to a millisecond or so, so sleep for
+    // most of the remaining time and yield for the rest
+    const sf::Time slack = sf::milliseconds(1);
+    sf::Time remaining = mTickLength - mAccumulator - mClock.getElapsedTime();
+    if(remaining > slack) sf::sleep(remaining - slack);
+    while(mAccumulator + mClock.getElapsedTime() < mTickLength)
+    {
+        std::this_thread::yield();
+    }
+}
+
+unsigned int TickScheduler::advance()
+{
+    mAccumulator += mClock.restart();
+    unsigned int ticks = 0;
+    while(mAccumulator >= mTickLength)
+    {
+        mAccumulator -= mTickLength;
+        if(ticks < mMaxCatchUp) ++ticks;
+        else ++mOverruns;
+    }
+    mTick += ticks;
+    return ticks;
+}
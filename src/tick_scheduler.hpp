@@ -0,0 +1,38 @@
+#ifndef TICK_SCHEDULER_HPP
+#define TICK_SCHEDULER_HPP
+
+#include <SFML/System.hpp>
+
+// Runs a simulation at a fixed rate. Time between ticks is slept away
+// instead of spinning, and if the simulation falls behind it catches
+// up by running several ticks back to back. If it falls further behind
+// than maxCatchUp ticks the extra time is dropped and counted as an
+// overrun, otherwise the server would never recover
+class TickScheduler
+{
+private:
+    sf::Clock mClock;
+    sf::Time mTickLength;
+    sf::Time mAccumulator;
+    unsigned int mMaxCatchUp;
+    sf::Uint64 mTick;
+    sf::Uint64 mOverruns;
+
+public:
+
+    TickScheduler(float rate, unsigned int maxCatchUp);
+
+    // Sleep until at least one tick is due
+    void wait();
+
+    // Return the number of ticks which are due, and consume them
+    unsigned int advance();
+
+    // Length of a tick in seconds. Every tick is the same length, so
+    // the simulation is deterministic per tick
+    float dt() const { return mTickLength.asSeconds(); }
+    sf::Uint64 tick() const { return mTick; }
+    sf::Uint64 overruns() const { return mOverruns; }
+};
+
+#endif /* TICK_SCHEDULER_HPP */
@@ -1,5 +1,7 @@
 #include <vector>
+#ifndef LD_HEADLESS
 #include <SFML/Graphics.hpp>
+#endif
 #include <JsonBox.h>
 
 #include "tileset.hpp"
@@ -25,6 +27,7 @@ Tilemap::Tilemap(const JsonBox::Array& a, Tileset* tileset)
     mTileset = tileset;
     ts = tileset->tilesize;
 
+#ifndef LD_HEADLESS
     mVerts.setPrimitiveType(sf::Quads);
     mVerts.resize(4 * w * h);
 
@@ -56,14 +59,17 @@ Tilemap::Tilemap(const JsonBox::Array& a, Tileset* tileset)
             }
         }
     }
+#endif
 }
 
+#ifndef LD_HEADLESS
 void Tilemap::draw(sf::RenderTarget& target, sf::RenderStates states) const
 {
     states.transform *= getTransform();
     states.texture = &mTileset->tex;
     target.draw(mVerts, states);
 }
+#endif
 
 unsigned int Tilemap::at(unsigned int x, unsigned int y) const
 {
@@ -2,18 +2,27 @@
 #define TILEMAP_HPP
 
 #include <vector>
-#include <SFML/Graphics.hpp>
+#include <JsonBox.h>
 #include <SFML/System.hpp>
+#ifndef LD_HEADLESS
+#include <SFML/Graphics.hpp>
+#endif
 
 #include "tileset.hpp"
 
-class Tilemap : public sf::Drawable, public sf::Transformable
+// Headless builds only have the tiles, for pathfinding
+class Tilemap
+#ifndef LD_HEADLESS
+    : public sf::Drawable, public sf::Transformable
+#endif
 {
 private:
     Tileset* mTileset;
+#ifndef LD_HEADLESS
     sf::VertexArray mVerts;
 
     virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+#endif
 
 public:
     unsigned int w;
@@ -1,6 +1,8 @@
 #include <string>
 #include <JsonBox.h>
+#ifndef LD_HEADLESS
 #include <SFML/Graphics.hpp>
+#endif
 
 #include "tileset.hpp"
 #include "entity.hpp"
@@ -12,7 +14,9 @@ Tileset::Tileset(const std::string& id,
     Entity(id),
     tilesize(tilesize)
 {
+#ifndef LD_HEADLESS
     tex.loadFromFile(filename);
+#endif
 }
 
 Tileset::Tileset(const std::string& id,
@@ -27,7 +31,9 @@ void Tileset::load(const JsonBox::Value& v, EntityManager* mgr)
 {
     JsonBox::Object o = v.getObject();
     tilesize = o["tilesize"].getInteger();
+#ifndef LD_HEADLESS
     tex.loadFromFile(o["filename"].getString());
+#endif
     if(o.find("animations") != o.end())
     {
         for(auto a : o["animations"].getArray())
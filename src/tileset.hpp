@@ -3,8 +3,11 @@
 
 #include <string>
 #include <JsonBox.h>
+#include <map>
+#include <SFML/System.hpp>
+#ifndef LD_HEADLESS
 #include <SFML/Graphics.hpp>
-#include <SFML/Window.hpp>
+#endif
 
 #include "entity.hpp"
 
@@ -23,10 +26,14 @@ public:
         x(pX), y(pY), len(pLen), duration(pDuration) {}
 };
 
+// Headless builds keep the tile size and animation timings, which the
+// simulation uses, but never load the image
 class Tileset : public Entity
 {
 public:
+#ifndef LD_HEADLESS
     sf::Texture tex;
+#endif
     unsigned int tilesize;
 
     std::map<std::string, Animation> animations;
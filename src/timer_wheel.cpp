@@ -0,0 +1,116 @@
+#include <vector>
+#include <SFML/System.hpp>
+
+#include "timer_wheel.hpp"
+
+const sf::Uint32 TimerWheel::none;
+
+TimerWheel::TimerWheel() :
+    mSlots(slotsBefore(levels), none),
+    mNow(0)
+{
+}
+
+void TimerWheel::link(sf::Uint32 id)
+{
+    Node& n = mNodes[id];
+    // Anything in the past fires on the next tick
+    sf::Uint64 expires = n.expires < mNow ? mNow : n.expires;
+    sf::Uint64 delta = expires - mNow;
+
+    unsigned int slot;
+    if(delta < (1 << rootBits))
+    {
+        slot = expires & ((1 << rootBits) - 1);
+    }
+    else
+    {
+        // Find the lowest level with a turn long enough to cover delta.
+        // Timers beyond the top level go in its furthest slot, and are
+        // relinked when it cascades
+        unsigned int level = 1;
+        unsigned int shift = rootBits;
+        while(level < levels - 1 && delta >= (sf::Uint64(1) << (shift + levelBits)))
+        {
+            ++level;
+            shift += levelBits;
+        }
+        sf::Uint64 maxDelta = (sf::Uint64(1) << (shift + levelBits)) - 1;
+        if(delta > maxDelta) expires = mNow + maxDelta;
+        slot = slotsBefore(level) + ((expires >> shift) & ((1 << levelBits) - 1));
+    }
+
+    n.slot = slot;
+    n.prev = none;
+    n.next = mSlots[slot];
+    if(n.next != none) mNodes[n.next].prev = id;
+    mSlots[slot] = id;
+}
+
+void TimerWheel::unlink(sf::Uint32 id)
+{
+    Node& n = mNodes[id];
+    if(n.prev != none) mNodes[n.prev].next = n.next;
+    else mSlots[n.slot] = n.next;
+    if(n.next != none) mNodes[n.next].prev = n.prev;
+    n.slot = none;
+}
+
+void TimerWheel::cascade(unsigned int level, unsigned int index)
+{
+    unsigned int slot = slotsBefore(level) + index;
+    sf::Uint32 id = mSlots[slot];
+    mSlots[slot] = none;
+    while(id != none)
+    {
+        sf::Uint32 next = mNodes[id].next;
+        link(id);
+        id = next;
+    }
+}
+
+void TimerWheel::set(sf::Uint32 id, sf::Uint64 tick)
+{
+    if(id >= mNodes.size())
+    {
+        mNodes.resize(id + 1, (Node){ none, none, none, 0 });
+    }
+    if(mNodes[id].slot != none) unlink(id);
+    mNodes[id].expires = tick;
+    link(id);
+}
+
+void TimerWheel::cancel(sf::Uint32 id)
+{
+    if(isSet(id)) unlink(id);
+}
+
+bool TimerWheel::isSet(sf::Uint32 id) const
+{
+    return id < mNodes.size() && mNodes[id].slot != none;
+}
+
+void TimerWheel::advance(sf::Uint64 tick, std::vector<sf::Uint32>& expired)
+{
+    for(; mNow < tick; ++mNow)
+    {
+        // At the start of each turn of a level, bring the next slot of
+        // the level above down into it
+        unsigned int index = mNow & ((1 << rootBits) - 1);
+        unsigned int shift = rootBits;
+        for(unsigned int level = 1; index == 0 && level < levels; ++level)
+        {
+            index = (mNow >> shift) & ((1 << levelBits) - 1);
+            cascade(level, index);
+            shift += levelBits;
+        }
+
+        unsigned int slot = mNow & ((1 << rootBits) - 1);
+        while(mSlots[slot] != none)
+        {
+            sf::Uint32 id = mSlots[slot];
+            unlink(id);
+            expired.push_back(id);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <vector>
+#include <SFML/System.hpp>
+
+// Hierarchical timer wheel, for timeouts on lots of ids which are
+// pushed back far more often than they expire. The first level has a
+// slot per tick, and each level above has slots covering a whole
+// turn of the level below, which are cascaded down a level as time
+// reaches them. Setting, moving and cancelling a timer are O(1), and
+// advancing costs O(1) per tick plus the timers which fire or cascade.
+// Ids index a flat array, so should be small and dense
+class TimerWheel
+{
+private:
+
+    static const unsigned int rootBits = 8;
+    static const unsigned int levelBits = 6;
+    static const unsigned int levels = 4;
+
+    static const sf::Uint32 none = 0xffffffff;
+
+    struct Node
+    {
+        sf::Uint32 prev;
+        sf::Uint32 next;
+        sf::Uint32 slot; // none if not scheduled
+        sf::Uint64 expires;
+    };
+
+    std::vector<Node> mNodes;
+    // Head of the list in each slot, with every level laid end to end
+    std::vector<sf::Uint32> mSlots;
+    // The next tick to be processed
+    sf::Uint64 mNow;
+
+    static unsigned int slotsBefore(unsigned int level)
+    {
+        return level == 0 ? 0 : (1 << rootBits) + (level - 1) * (1 << levelBits);
+    }
+
+    void link(sf::Uint32 id);
+    void unlink(sf::Uint32 id);
+    // Move every timer in a higher level slot to wherever it belongs now
+    void cascade(unsigned int level, unsigned int index);
+
+public:
+
+    TimerWheel();
+
+    // Fire id on the given tick, replacing any timer it already has
+    void set(sf::Uint32 id, sf::Uint64 tick);
+    void cancel(sf::Uint32 id);
+    bool isSet(sf::Uint32 id) const;
+
+    // Process every tick before the given one, adding the ids of the
+    // timers which fired to expired
+    void advance(sf::Uint64 tick, std::vector<sf::Uint32>& expired);
+
+    sf::Uint64 now() const { return mNow; }
+};
+
+#endif /* TIMER_WHEEL_HPP */
@@ -0,0 +1,35 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+// Where the NetworkManager's packets actually go. Lets the same
+// NetworkManager run over a real UDP socket or over an in-memory
+// network, so one process can host a server and its clients
+class Transport
+{
+public:
+
+    virtual ~Transport() {}
+
+    virtual sf::Socket::Status send(sf::Packet& packet,
+        const sf::IpAddress& remoteAddress, unsigned short remotePort) = 0;
+
+    // Block until a packet arrives. May give up early and return
+    // NotReady, so the caller gets a chance to stop
+    virtual sf::Socket::Status receive(sf::Packet& packet,
+        sf::IpAddress& remoteAddress, unsigned short& remotePort) = 0;
+
+    // Make a receive blocked in another thread return NotReady as soon
+    // as it can. Transports which can't be woken give up on their own
+    // shortly anyway
+    virtual void wake() {}
+
+    virtual unsigned short getLocalPort() const = 0;
+
+    // The address the host at remoteAddress can reach us on
+    virtual sf::IpAddress getAddressFor(const sf::IpAddress& remoteAddress) const = 0;
+};
+
+#endif /* TRANSPORT_HPP */
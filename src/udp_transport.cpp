@@ -0,0 +1,247 @@
+#include <stdexcept>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#endif
+
+#include "udp_transport.hpp"
+
+#ifdef __linux__
+
+// Tags the eventfd in epoll, apart from the socket indices
+static const uint64_t wakeTag = UINT64_MAX;
+
+UdpTransport::UdpTransport(unsigned short port, unsigned int sockets) :
+    mPort(port),
+    mEpoll(-1),
+    mWake(-1),
+    mNext(0)
+{
+    auto fail = [this](const std::string& what) {
+        std::string msg = what + ": " + std::strerror(errno);
+        close();
+        throw std::runtime_error(msg);
+    };
+
+    mEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if(mEpoll < 0) fail("Failed to create epoll instance");
+    mWake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(mWake < 0) fail("Failed to create eventfd");
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = wakeTag;
+    if(epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWake, &ev) < 0) fail("Failed to watch eventfd");
+
+    for(unsigned int i = 0; i < std::max(sockets, 1u); ++i)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(fd < 0) fail("Failed to create socket");
+        mSockets.push_back(fd);
+        int yes = 1;
+        // Only needed to share the port, but harmless otherwise
+        if(sockets > 1 && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0)
+        {
+            fail("Failed to share port " + std::to_string(mPort));
+        }
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        // Port 0 picks a free port for the first socket, and the rest
+        // join it there
+        addr.sin_port = htons(mPort);
+        if(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+        {
+            fail("Failed to open socket on port " + std::to_string(mPort));
+        }
+        if(mPort == 0)
+        {
+            socklen_t size = sizeof(addr);
+            getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &size);
+            mPort = ntohs(addr.sin_port);
+        }
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        if(epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &ev) < 0) fail("Failed to watch socket");
+    }
+}
+
+UdpTransport::~UdpTransport()
+{
+    close();
+}
+
+void UdpTransport::close()
+{
+    for(int fd : mSockets) ::close(fd);
+    mSockets.clear();
+    if(mWake >= 0) ::close(mWake);
+    if(mEpoll >= 0) ::close(mEpoll);
+    mWake = mEpoll = -1;
+}
+
+sf::Socket::Status UdpTransport::send(sf::Packet& packet,
+    const sf::IpAddress& remoteAddress, unsigned short remotePort)
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(remoteAddress.toInteger());
+    addr.sin_port = htons(remotePort);
+    // Every socket has the same port, so it doesn't matter which sends
+    ssize_t sent = sendto(mSockets[0], packet.getData(), packet.getDataSize(), 0,
+        reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    if(sent >= 0) return sf::Socket::Done;
+    // A full send buffer loses the packet, as the network could have
+    return errno == EAGAIN || errno == EWOULDBLOCK ?
+        sf::Socket::NotReady : sf::Socket::Error;
+}
+
+sf::Socket::Status UdpTransport::receive(sf::Packet& packet,
+    sf::IpAddress& remoteAddress, unsigned short& remotePort)
+{
+    // Big enough for any UDP datagram
+    static thread_local char buffer[65536];
+
+    for(int attempt = 0; attempt < 2; ++attempt)
+    {
+        // Take whatever is already waiting before sleeping
+        for(size_t i = 0; i < mSockets.size(); ++i)
+        {
+            int fd = mSockets[(mNext + i) % mSockets.size()];
+            sockaddr_in addr;
+            socklen_t size = sizeof(addr);
+            ssize_t received = recvfrom(fd, buffer, sizeof(buffer), 0,
+                reinterpret_cast<sockaddr*>(&addr), &size);
+            if(received < 0)
+            {
+                // Errors from ICMP replies to earlier sends turn up
+                // here too, and say nothing about this socket
+                if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED) continue;
+                return sf::Socket::Error;
+            }
+            mNext = (mNext + i + 1) % mSockets.size();
+            packet.clear();
+            packet.append(buffer, received);
+            remoteAddress = sf::IpAddress(ntohl(addr.sin_addr.s_addr));
+            remotePort = ntohs(addr.sin_port);
+            return sf::Socket::Done;
+        }
+        if(attempt > 0) break;
+
+        epoll_event events[16];
+        int n = epoll_wait(mEpoll, events, 16, receiveTimeoutMs);
+        if(n < 0) return errno == EINTR ? sf::Socket::NotReady : sf::Socket::Error;
+        if(n == 0) return sf::Socket::NotReady;
+        for(int i = 0; i < n; ++i)
+        {
+            if(events[i].data.u64 == wakeTag)
+            {
+                // Woken, so let the caller check if it should stop
+                eventfd_t value;
+                eventfd_read(mWake, &value);
+                return sf::Socket::NotReady;
+            }
+        }
+    }
+    return sf::Socket::NotReady;
+}
+
+void UdpTransport::wake()
+{
+    eventfd_write(mWake, 1);
+}
+
+#else
+
+UdpTransport::UdpTransport(unsigned short port, unsigned int sockets) :
+    mPort(port)
+{
+    // Without SO_REUSEPORT only one socket can have the port
+    std::unique_ptr<sf::UdpSocket> socket(new sf::UdpSocket);
+    if(socket->bind(port) != sf::Socket::Done)
+    {
+        throw std::runtime_error("Failed to open socket on port "
+            + std::to_string(port));
+    }
+    mPort = socket->getLocalPort();
+    socket->setBlocking(false);
+    mSelector.add(*socket);
+    mSockets.push_back(std::move(socket));
+}
+
+UdpTransport::~UdpTransport()
+{
+    for(auto& socket : mSockets) socket->unbind();
+}
+
+sf::Socket::Status UdpTransport::send(sf::Packet& packet,
+    const sf::IpAddress& remoteAddress, unsigned short remotePort)
+{
+    return mSockets[0]->send(packet, remoteAddress, remotePort);
+}
+
+sf::Socket::Status UdpTransport::receive(sf::Packet& packet,
+    sf::IpAddress& remoteAddress, unsigned short& remotePort)
+{
+    sf::Socket::Status status = mSockets[0]->receive(packet, remoteAddress, remotePort);
+    if(status != sf::Socket::NotReady) return status;
+    if(!mSelector.wait(sf::milliseconds(receiveTimeoutMs))) return sf::Socket::NotReady;
+    return mSockets[0]->receive(packet, remoteAddress, remotePort);
+}
+
+void UdpTransport::wake()
+{
+    // The selector can't be interrupted, but receive gives up soon
+}
+
+#endif
+
+unsigned short UdpTransport::getLocalPort() const
+{
+    return mPort;
+}
+
+sf::IpAddress UdpTransport::getAddressFor(const sf::IpAddress& remoteAddress) const
+{
+    // Work out if this is the remote address is WAN or LAN
+    // This is not great and probably doesn't actually work,
+    // it just assumes an IP is local iff it's in reserved in RFC1918.
+    // Needed because the address is used in events to identify the host.
+    // Note that this does not support a situation where people are connected
+    // to the same server with some on LAN and some on WAN, but this solution
+    // is simple and that's all I care about for now
+    // TODO: Support simultaneous LAN & WAN connections
+    std::string ipStr = remoteAddress.toString();
+    for(int i = 0; i < ipStr.size(); ++i)
+    {
+        if(ipStr[i] == '.') ipStr[i] = ' ';
+    }
+    std::istringstream ipStrIs(ipStr);
+    int blocks[4] = {0,0,0,0};
+    ipStrIs >> blocks[0] >> blocks[1] >> blocks[2] >> blocks[3];
+    if(remoteAddress == sf::IpAddress::LocalHost ||
+        blocks[0] == 10 ||
+        (blocks[0] == 172 && 16 <= blocks[1] && blocks[1] <= 31) ||
+        (blocks[0] == 192 && blocks[1] == 168))
+    {
+        return sf::IpAddress::getLocalAddress();
+    }
+    else
+    {
+        return sf::IpAddress::getPublicAddress();
+    }
+}
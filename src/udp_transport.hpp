@@ -0,0 +1,58 @@
+#ifndef UDP_TRANSPORT_HPP
+#define UDP_TRANSPORT_HPP
+
+#include <memory>
+#include <vector>
+#include <SFML/System.hpp>
+#include <SFML/Network.hpp>
+
+#include "transport.hpp"
+
+// Transport over real UDP sockets. On Linux the sockets are non-blocking
+// and waited on with epoll, alongside an eventfd so wake can interrupt
+// a receive straight away. Several sockets can share the port with
+// SO_REUSEPORT, so the kernel spreads clients across their buffers.
+// Elsewhere SFML's sockets and selector are used, which can't be woken
+// but still give up after a short wait
+class UdpTransport : public Transport
+{
+private:
+
+    unsigned short mPort;
+
+#ifdef __linux__
+    std::vector<int> mSockets;
+    int mEpoll;
+    int mWake;
+    // Socket to try first on the next receive, so a busy socket can't
+    // starve the others
+    size_t mNext;
+
+    void close();
+#else
+    std::vector<std::unique_ptr<sf::UdpSocket>> mSockets;
+    sf::SocketSelector mSelector;
+#endif
+
+public:
+
+    // How long a receive waits for a packet before giving up
+    static const sf::Int32 receiveTimeoutMs = 100;
+
+    // Bind the given number of sockets to the port, or to any free port
+    // if it's 0. Throws if the port can't be bound
+    explicit UdpTransport(unsigned short port, unsigned int sockets = 1);
+    ~UdpTransport();
+
+    sf::Socket::Status send(sf::Packet& packet,
+        const sf::IpAddress& remoteAddress, unsigned short remotePort);
+    // Gives up and returns NotReady after receiveTimeoutMs, or as soon
+    // as wake is called
+    sf::Socket::Status receive(sf::Packet& packet,
+        sf::IpAddress& remoteAddress, unsigned short& remotePort);
+    void wake();
+    unsigned short getLocalPort() const;
+    sf::IpAddress getAddressFor(const sf::IpAddress& remoteAddress) const;
+};
+
+#endif /* UDP_TRANSPORT_HPP */
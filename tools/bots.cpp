@@ -0,0 +1,550 @@
+#include <SFML/Network.hpp>
+#include <SFML/System.hpp>
+#include <JsonBox.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "entity_manager.hpp"
+#include "network_manager.hpp"
+#include "loopback_transport.hpp"
+#include "game_map.hpp"
+#include "snapshot.hpp"
+#include "relay.hpp"
+#include "server.hpp"
+#include "tick_scheduler.hpp"
+
+class Tileset;
+class Character;
+
+// Headless load test. Runs a server and a crowd of bot players in one
+// process, connected by a LoopbackNetwork, then reports how hard the
+// server had to work. Settings come from the bots block of config.json,
+// and the first four arguments override the number of players, the
+// number of games, how many seconds to run for and the number of
+// spectators. Spectators watch through a relay, run in the same process
+// from the relay block
+
+struct BotSettings
+{
+    unsigned int players;
+    unsigned int games;
+    // Spread over the games like the players are
+    unsigned int spectators;
+    float duration;
+    // Orders per second each bot gives, on average
+    float moveRate;
+    float attackRate;
+    float keepaliveInterval;
+    LoopbackNetwork::Settings loopback;
+};
+
+struct Bot
+{
+    enum class State
+    {
+        Connecting,
+        Playing,
+        Rejected
+    };
+
+    std::unique_ptr<NetworkManager> nmgr;
+    std::thread poller;
+
+    State state;
+    sf::Uint16 gameId;
+    sf::Uint8 charId;
+    sf::Vector2f pos;
+    sf::Uint16 moveSequence;
+
+    SnapshotHistory snapshots;
+    sf::Uint32 latestSnapshot;
+
+    // Seconds into the run each order is next due
+    float nextMove;
+    float nextAttack;
+    float nextKeepalive;
+
+    float connectedAt;
+    sf::Uint64 received;
+};
+
+struct Spectator
+{
+    std::unique_ptr<NetworkManager> nmgr;
+    std::thread poller;
+
+    sf::Uint16 gameId;
+    // Given by the relay when it takes us on, 255 until then
+    sf::Uint8 viewerId;
+
+    SnapshotHistory snapshots;
+    sf::Uint32 latestSnapshot;
+
+    // The relay forgets viewers who don't ask again every so often
+    float nextSpectate;
+
+    sf::Uint64 received;
+};
+
+void pollNetworkEvents(NetworkManager* nmgr, std::atomic<bool>* kill)
+{
+    while(!*kill)
+    {
+        nmgr->waitEvent();
+    }
+}
+
+BotSettings loadSettings(const JsonBox::Value& v)
+{
+    BotSettings s = { 100, 10, 0, 30.0f, 1.0f, 0.2f, 1.0f, { 0.05f, 0.01f, 0.0f, 1 } };
+    JsonBox::Object o = v.getObject();
+    auto has = [&o](const std::string& k) { return o.find(k) != o.end(); };
+    if(has("players")) s.players = o["players"].tryGetInteger(s.players);
+    if(has("games")) s.games = o["games"].tryGetInteger(s.games);
+    if(has("spectators")) s.spectators = o["spectators"].tryGetInteger(s.spectators);
+    if(has("duration")) s.duration = o["duration"].tryGetFloat(s.duration);
+    if(has("moveRate")) s.moveRate = o["moveRate"].tryGetFloat(s.moveRate);
+    if(has("attackRate")) s.attackRate = o["attackRate"].tryGetFloat(s.attackRate);
+    if(has("keepaliveInterval")) s.keepaliveInterval = o["keepaliveInterval"].tryGetFloat(s.keepaliveInterval);
+    if(has("loopback"))
+    {
+        JsonBox::Object l = o["loopback"].getObject();
+        if(l.count("latency") > 0) s.loopback.latency = l["latency"].tryGetFloat(s.loopback.latency);
+        if(l.count("jitter") > 0) s.loopback.jitter = l["jitter"].tryGetFloat(s.loopback.jitter);
+        if(l.count("loss") > 0) s.loopback.loss = l["loss"].tryGetFloat(s.loopback.loss);
+        if(l.count("seed") > 0) s.loopback.seed = l["seed"].tryGetInteger(s.loopback.seed);
+    }
+    return s;
+}
+
+// Decode a snapshot exactly as the real client does, so whoever sent
+// it gets acks and can send deltas. False if it's older than the
+// latest or its baseline has been forgotten
+bool decode(const Snapshot& delta, SnapshotHistory& snapshots,
+    sf::Uint32& latestSnapshot, Snapshot& full)
+{
+    if(delta.sequence <= latestSnapshot) return false;
+    const Snapshot* baseline = snapshots.get(delta.baseline);
+    if(delta.baseline != 0 && baseline == nullptr) return false;
+    full = baseline == nullptr ? delta : delta.merge(*baseline);
+    snapshots.store(full);
+    latestSnapshot = full.sequence;
+    return true;
+}
+
+// Deal with everything the server has sent a bot
+void handleEvents(Bot& bot, float now)
+{
+    NetworkManager::Event netEvent;
+    while(bot.nmgr->pollEvent(netEvent))
+    {
+        ++bot.received;
+        switch(netEvent.type)
+        {
+            default:
+                break;
+            case NetworkManager::Event::Connect:
+            {
+                auto& e = netEvent.connect;
+                // Everyone in the game is told, so make sure it's us
+                if(bot.state != Bot::State::Connecting ||
+                    e.ip != bot.nmgr->getIp() || e.port != bot.nmgr->getPort())
+                {
+                    break;
+                }
+                bot.state = Bot::State::Playing;
+                bot.gameId = e.gameId;
+                bot.charId = e.charId;
+                bot.connectedAt = now;
+                break;
+            }
+            case NetworkManager::Event::GameFull:
+                bot.state = Bot::State::Rejected;
+                break;
+            case NetworkManager::Event::Move:
+            {
+                auto& e = netEvent.move;
+                // The server corrected us
+                if(bot.state == Bot::State::Playing && e.gameId == bot.gameId &&
+                    e.charId == bot.charId)
+                {
+                    bot.pos = e.pos;
+                }
+                break;
+            }
+            case NetworkManager::Event::Snapshot:
+            {
+                if(bot.state != Bot::State::Playing) break;
+                if(netEvent.snapshot.gameId != bot.gameId) break;
+                Snapshot full;
+                if(!decode(*netEvent.delta, bot.snapshots, bot.latestSnapshot, full)) break;
+                auto it = full.characters.find(bot.charId);
+                if(it != full.characters.end()) bot.pos = it->second.pos;
+
+                NetworkManager::Event response;
+                response.type = NetworkManager::Event::SnapshotAck;
+                response.snapshotAck = {
+                    .gameId = bot.gameId,
+                    .charId = bot.charId,
+                    .sequence = full.sequence
+                };
+                bot.nmgr->send(response);
+                break;
+            }
+        }
+    }
+}
+
+// Deal with everything the relay has sent a spectator
+void handleEvents(Spectator& spectator, unsigned short relayPort)
+{
+    NetworkManager::Event netEvent;
+    while(spectator.nmgr->pollEvent(netEvent))
+    {
+        switch(netEvent.type)
+        {
+            default:
+                break;
+            case NetworkManager::Event::Spectate:
+            {
+                // The relay confirms with the id to ack with
+                auto& e = netEvent.spectate;
+                if(e.gameId != spectator.gameId || e.leave) break;
+                spectator.viewerId = e.viewerId;
+                break;
+            }
+            case NetworkManager::Event::Snapshot:
+            {
+                if(spectator.viewerId == 255) break;
+                if(netEvent.snapshot.gameId != spectator.gameId) break;
+                Snapshot full;
+                if(!decode(*netEvent.delta, spectator.snapshots,
+                    spectator.latestSnapshot, full)) break;
+                ++spectator.received;
+
+                // Viewers ack with their viewerId in place of a charId
+                NetworkManager::Event response;
+                response.type = NetworkManager::Event::SnapshotAck;
+                response.snapshotAck = {
+                    .gameId = spectator.gameId,
+                    .charId = spectator.viewerId,
+                    .sequence = full.sequence
+                };
+                spectator.nmgr->send(response, sf::IpAddress::LocalHost, relayPort);
+                break;
+            }
+        }
+    }
+}
+
+// Ask the relay to start or keep showing a spectator their game
+void watch(Spectator& spectator, float now, const BotSettings& settings,
+    unsigned short relayPort)
+{
+    if(now < spectator.nextSpectate) return;
+    spectator.nextSpectate = now + settings.keepaliveInterval;
+    NetworkManager::Event e;
+    e.type = NetworkManager::Event::Spectate;
+    e.spectate = {
+        .ip = spectator.nmgr->getIp(),
+        .port = spectator.nmgr->getPort(),
+        .gameId = spectator.gameId,
+        .viewerId = 255,
+        .leave = false
+    };
+    spectator.nmgr->send(e, sf::IpAddress::LocalHost, relayPort);
+}
+
+// Give whatever orders are due
+void act(Bot& bot, float now, const BotSettings& settings,
+    const std::vector<sf::Vector2f>& targets, std::mt19937& rng)
+{
+    if(bot.state != Bot::State::Playing) return;
+
+    std::exponential_distribution<float> moveGap(settings.moveRate);
+    std::exponential_distribution<float> attackGap(settings.attackRate);
+
+    if(settings.moveRate > 0.0f && now >= bot.nextMove && !targets.empty())
+    {
+        bot.nextMove = now + moveGap(rng);
+        NetworkManager::Event e;
+        e.type = NetworkManager::Event::Move;
+        e.move = {
+            .gameId = bot.gameId,
+            .charId = bot.charId,
+            .target = targets[rng() % targets.size()],
+            .pos = bot.pos,
+            .sequence = bot.moveSequence++
+        };
+        bot.nmgr->send(e);
+    }
+    if(settings.attackRate > 0.0f && now >= bot.nextAttack)
+    {
+        bot.nextAttack = now + attackGap(rng);
+        NetworkManager::Event e;
+        e.type = NetworkManager::Event::AutoAttack;
+        e.autoAttack = {
+            .gameId = bot.gameId,
+            .charId = bot.charId,
+            .targetId = static_cast<sf::Uint8>(rng() % (2 * GameContainer::playersPerTeam)),
+            .cancel = false
+        };
+        bot.nmgr->send(e);
+    }
+    if(now >= bot.nextKeepalive)
+    {
+        bot.nextKeepalive = now + settings.keepaliveInterval;
+        NetworkManager::Event e;
+        e.type = NetworkManager::Event::Keepalive;
+        e.keepalive = {
+            .gameId = bot.gameId,
+            .charId = bot.charId
+        };
+        bot.nmgr->send(e);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    EntityManager entityManager;
+    entityManager.load<Tileset>("tilesets.json");
+    entityManager.load<GameMap>("game_map.json");
+    entityManager.load<Character>("characters.json");
+
+    JsonBox::Value configFile;
+    configFile.loadFromFile("config.json");
+    BotSettings settings = loadSettings(configFile["bots"]);
+    if(argc > 1) settings.players = std::atoi(argv[1]);
+    if(argc > 2) settings.games = std::max(1, std::atoi(argv[2]));
+    if(argc > 3) settings.duration = std::atof(argv[3]);
+    if(argc > 4) settings.spectators = std::atoi(argv[4]);
+
+    // Bots walk to random walkable tiles
+    GameMap* map = entityManager.getEntity<GameMap>("gamemap_5v5");
+    std::vector<sf::Vector2f> targets;
+    for(const auto& node : map->graph.edges)
+    {
+        targets.push_back(sf::Vector2f(node.first.x, node.first.y));
+    }
+
+    LoopbackNetwork network(settings.loopback);
+    std::mt19937 rng(settings.loopback.seed);
+
+    // Server, on the port from the config, with its own network thread
+    JsonBox::Object serverO = configFile["server"].getObject();
+    unsigned short serverPort = serverO.count("port") > 0 ?
+        serverO["port"].getInteger() : 49518;
+    NetworkManager serverNmgr(network.open(serverPort), true);
+    if(serverO.count("rateLimits") > 0) serverNmgr.setRateLimits(serverO["rateLimits"]);
+    Server server(configFile["server"], &serverNmgr, &entityManager);
+    std::atomic<bool> kill(false);
+    std::atomic<bool> serverDone(false);
+    std::thread serverPoller(pollNetworkEvents, &serverNmgr, &kill);
+    std::thread serverThread([&server, &serverDone]() {
+        server.run();
+        serverDone = true;
+    });
+
+    // Relay, pointed at the server above whatever the config says
+    JsonBox::Value relayConfig = configFile["relay"];
+    relayConfig["target"]["address"] = JsonBox::Value("127.0.0.1");
+    relayConfig["target"]["port"] = JsonBox::Value(static_cast<int>(serverPort));
+    unsigned short relayPort = relayConfig.getObject().count("port") > 0 ?
+        relayConfig["port"].getInteger() : 49530;
+    std::unique_ptr<NetworkManager> relayNmgr;
+    std::unique_ptr<Relay> relay;
+    std::thread relayPoller;
+    std::thread relayThread;
+    if(settings.spectators > 0)
+    {
+        relayNmgr.reset(new NetworkManager(network.open(relayPort), true));
+        relay.reset(new Relay(relayConfig, relayNmgr.get()));
+        relayPoller = std::thread(pollNetworkEvents, relayNmgr.get(), &kill);
+        relayThread = std::thread(&Relay::run, relay.get());
+    }
+
+    std::cout << "Running " << settings.players << " bots across "
+        << settings.games << " games for " << settings.duration << "s";
+    if(settings.spectators > 0) std::cout << ", watched by " << settings.spectators;
+    std::cout << std::endl;
+
+    // Bots are spread evenly over the games, and join over the first
+    // second rather than all at once
+    std::vector<std::unique_ptr<Bot>> bots;
+    std::vector<float> joinAt;
+    for(unsigned int i = 0; i < settings.players; ++i)
+    {
+        std::unique_ptr<Bot> bot(new Bot);
+        bot->nmgr.reset(new NetworkManager(network.open(), false));
+        bot->state = Bot::State::Connecting;
+        bot->gameId = i % settings.games;
+        bot->charId = 255;
+        bot->moveSequence = 0;
+        bot->latestSnapshot = 0;
+        bot->nextMove = bot->nextAttack = bot->nextKeepalive = 0.0f;
+        bot->connectedAt = -1.0f;
+        bot->received = 0;
+        bot->poller = std::thread(pollNetworkEvents, bot->nmgr.get(), &kill);
+        joinAt.push_back(float(i) / std::max(1u, settings.players));
+        bots.push_back(std::move(bot));
+    }
+
+    // Spectators start watching once the players have had time to make
+    // the games
+    std::vector<std::unique_ptr<Spectator>> spectators;
+    for(unsigned int i = 0; i < settings.spectators; ++i)
+    {
+        std::unique_ptr<Spectator> spectator(new Spectator);
+        spectator->nmgr.reset(new NetworkManager(network.open(), false));
+        spectator->gameId = i % settings.games;
+        spectator->viewerId = 255;
+        spectator->latestSnapshot = 0;
+        spectator->nextSpectate = 1.0f;
+        spectator->received = 0;
+        spectator->poller = std::thread(pollNetworkEvents, spectator->nmgr.get(), &kill);
+        spectators.push_back(std::move(spectator));
+    }
+
+    sf::Clock clock;
+    std::vector<float> connectStart(bots.size(), -1.0f);
+    TickScheduler scheduler(60.0f, 5);
+    while(clock.getElapsedTime().asSeconds() < settings.duration)
+    {
+        scheduler.wait();
+        scheduler.advance();
+        float now = clock.getElapsedTime().asSeconds();
+        for(size_t i = 0; i < bots.size(); ++i)
+        {
+            Bot& bot = *bots[i];
+            if(connectStart[i] < 0.0f && now >= joinAt[i])
+            {
+                connectStart[i] = now;
+                bot.nmgr->connectToServer(sf::IpAddress::LocalHost, serverPort, bot.gameId);
+            }
+            handleEvents(bot, now);
+            act(bot, now, settings, targets, rng);
+            bot.nmgr->update();
+        }
+        for(auto& spectator : spectators)
+        {
+            handleEvents(*spectator, relayPort);
+            watch(*spectator, now, settings, relayPort);
+            spectator->nmgr->update();
+        }
+    }
+
+    // Collect results before anyone leaves
+    unsigned int playing = 0;
+    unsigned int rejected = 0;
+    float connectTotal = 0.0f;
+    float connectMax = 0.0f;
+    float rttTotal = 0.0f;
+    float rttMax = 0.0f;
+    sf::Uint64 received = 0;
+    for(size_t i = 0; i < bots.size(); ++i)
+    {
+        Bot& bot = *bots[i];
+        received += bot.received;
+        if(bot.state == Bot::State::Rejected) ++rejected;
+        if(bot.state != Bot::State::Playing) continue;
+        ++playing;
+        float connect = bot.connectedAt - connectStart[i];
+        connectTotal += connect;
+        connectMax = std::max(connectMax, connect);
+        float rtt = bot.nmgr->getRtt(sf::IpAddress::LocalHost, serverPort);
+        rttTotal += rtt;
+        rttMax = std::max(rttMax, rtt);
+    }
+    unsigned int watching = 0;
+    sf::Uint64 watched = 0;
+    for(const auto& spectator : spectators)
+    {
+        if(spectator->viewerId != 255) ++watching;
+        watched += spectator->received;
+    }
+    float elapsed = clock.getElapsedTime().asSeconds();
+    sf::Uint64 sent = network.sent();
+    sf::Uint64 dropped = network.dropped();
+
+    // The relay unsubscribes as it goes, so stop it while the server
+    // is still there to hear
+    if(relay)
+    {
+        relay->stop();
+        relayThread.join();
+        relay.reset();
+    }
+
+    // Leave, then stop the server with its shutdown message. Keep
+    // pumping so lost messages are resent
+    for(auto& bot : bots)
+    {
+        if(bot->state == Bot::State::Playing)
+        {
+            bot->nmgr->disconnectFromServer(bot->gameId, bot->charId);
+        }
+    }
+    if(!bots.empty())
+    {
+        NetworkManager::Event e;
+        e.type = NetworkManager::Event::Disconnect;
+        e.disconnect = {
+            .ip = bots[0]->nmgr->getIp(),
+            .port = bots[0]->nmgr->getPort(),
+            .gameId = 65535,
+            .charId = 255
+        };
+        bots[0]->nmgr->send(e, sf::IpAddress::LocalHost, serverPort);
+    }
+    while(!serverDone && !bots.empty())
+    {
+        sf::sleep(sf::milliseconds(10));
+        for(auto& bot : bots) bot->nmgr->update();
+    }
+    serverThread.join();
+    kill = true;
+    serverNmgr.wake();
+    for(auto& bot : bots) bot->nmgr->wake();
+    for(auto& spectator : spectators) spectator->nmgr->wake();
+    if(relayNmgr) relayNmgr->wake();
+    serverPoller.join();
+    for(auto& bot : bots) bot->poller.join();
+    for(auto& spectator : spectators) spectator->poller.join();
+    if(relayPoller.joinable()) relayPoller.join();
+
+    const Server::Stats& stats = server.stats();
+    float ticks = std::max(sf::Uint64(1), stats.ticks);
+    float loops = std::max(sf::Uint64(1), stats.loops);
+    std::cout << "Players: " << playing << " playing, " << rejected
+        << " rejected, " << settings.players - playing - rejected
+        << " never connected" << std::endl;
+    std::cout << "Server: " << stats.ticks << " ticks, "
+        << stats.overruns << " overruns, "
+        << stats.busy.asSeconds() * 1000.0f / loops << "ms mean and "
+        << stats.maxBusy.asSeconds() * 1000.0f << "ms max busy per wake, "
+        << stats.busy.asSeconds() * 1000.0f / ticks << "ms per tick" << std::endl;
+    std::cout << "Latency: connect " << (playing ? connectTotal / playing : 0.0f) * 1000.0f
+        << "ms mean, " << connectMax * 1000.0f << "ms max; rtt "
+        << (playing ? rttTotal / playing : 0.0f) * 1000.0f << "ms mean, "
+        << rttMax * 1000.0f << "ms max" << std::endl;
+    std::cout << "Packets: " << sent / elapsed << "/s sent, "
+        << dropped / elapsed << "/s dropped, "
+        << received / elapsed << "/s events to bots, "
+        << stats.events / elapsed << "/s events to server, "
+        << stats.coalesced / elapsed << "/s moves coalesced" << std::endl;
+    if(!spectators.empty())
+    {
+        std::cout << "Spectators: " << watching << " watching, "
+            << settings.spectators - watching << " never taken on, "
+            << (watching ? watched / elapsed / watching : 0.0f)
+            << "/s snapshots each" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <SFML/Network.hpp>
+#include <SFML/System.hpp>
+#include <JsonBox.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "entity_manager.hpp"
+#include "network_manager.hpp"
+#include "replay_transport.hpp"
+#include "server.hpp"
+
+class Tileset;
+class GameMap;
+class Character;
+
+// Feeds a capture made with the server's capture setting back into a
+// fresh server, so the same load can be run again and again when
+// checking the server's performance. Usage is
+//     minild66-replay <capture file> [speed]
+// where speed 1 is as captured, 2 is twice as fast and so on, and 0
+// is as fast as the server will take them
+
+void pollNetworkEvents(NetworkManager* nmgr, std::atomic<bool>* kill)
+{
+    while(!*kill)
+    {
+        nmgr->waitEvent();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <capture file> [speed]" << std::endl;
+        return 1;
+    }
+    float speed = argc > 2 ? std::atof(argv[2]) : 1.0f;
+
+    EntityManager entityManager;
+    entityManager.load<Tileset>("tilesets.json");
+    entityManager.load<GameMap>("game_map.json");
+    entityManager.load<Character>("characters.json");
+
+    JsonBox::Value configFile;
+    configFile.loadFromFile("config.json");
+
+    ReplayTransport* replay = new ReplayTransport(argv[1], std::max(0.0f, speed));
+    NetworkManager nmgr(std::unique_ptr<Transport>(replay), true);
+    // Limited as the live server was, or floods would replay differently
+    JsonBox::Object serverO = configFile["server"].getObject();
+    if(serverO.count("rateLimits") > 0) nmgr.setRateLimits(serverO["rateLimits"]);
+    Server server(configFile["server"], &nmgr, &entityManager);
+
+    std::atomic<bool> kill(false);
+    std::thread poller(pollNetworkEvents, &nmgr, &kill);
+    std::thread watcher([replay, &server]() {
+        while(!replay->finished()) sf::sleep(sf::milliseconds(10));
+        // Give the server a moment to handle the last of them
+        sf::sleep(sf::milliseconds(100));
+        server.stop();
+    });
+
+    sf::Clock clock;
+    server.run();
+    float elapsed = clock.getElapsedTime().asSeconds();
+    watcher.join();
+    kill = true;
+    nmgr.wake();
+    poller.join();
+
+    const Server::Stats& stats = server.stats();
+    float ticks = std::max(sf::Uint64(1), stats.ticks);
+    float loops = std::max(sf::Uint64(1), stats.loops);
+    std::cout << "Replayed " << replay->replayed() << " packets in "
+        << elapsed << "s" << std::endl;
+    std::cout << "Server: " << stats.ticks << " ticks, "
+        << stats.overruns << " overruns, " << stats.events << " events, "
+        << stats.busy.asSeconds() * 1000.0f / loops << "ms mean and "
+        << stats.maxBusy.asSeconds() * 1000.0f << "ms max busy per wake, "
+        << stats.busy.asSeconds() * 1000.0f / ticks << "ms per tick" << std::endl;
+    std::cout << "Sent " << replay->sent() << " packets, "
+        << replay->sentBytes() << " bytes" << std::endl;
+
+    return 0;
+}